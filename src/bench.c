@@ -0,0 +1,510 @@
+//! @file bench.c
+//! Benchmarks for the library, run with `make bench`.
+//! Not part of the library.
+
+#include <crelude/common.h>
+#include <crelude/io.h>
+#include <crelude/simd.h>
+#include <crelude/byteorder.h>
+#include <crelude/deque.h>
+#include <crelude/segment.h>
+#include <crelude/bitset.h>
+#include <crelude/sort.h>
+#include <crelude/thread.h>
+#include <crelude/search.h>
+#include <crelude/parallel.h>
+#include <crelude/table.h>
+#include <crelude/vmem.h>
+
+#include <time.h>
+
+#define BENCH(DOES) do { \
+	println("\n" ANSI(BOLD) "[###]" ANSI(RESET) " "\
+		ANSI(UNDER) "Benchmark" ANSI(RESET) ": %s", DOES); \
+} while (false); always
+
+#define COUNT(ARR) (sizeof(ARR) / sizeof(*(ARR)))
+
+/// Monotonic time in seconds.
+static f64 now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// Time the body, repeated `TIMES` times, in nanoseconds per repetition.
+#define TIME(TIMES, ...) __extension__({ \
+	usize _times = (TIMES); \
+	f64 _start = now(); \
+	for (usize _time_rep = 0; _time_rep < _times; ++_time_rep) { __VA_ARGS__; } \
+	(now() - _start) * 1e9 / _times; })
+
+/// Rotation by three reversals, for comparison with `memrotate`.
+static u0 reverse_bytes(umin *blk, usize bytes)
+{
+	for (usize i = 0, j = bytes; i < j--; ++i) {
+		umin tmp = blk[i];
+		blk[i] = blk[j];
+		blk[j] = tmp;
+	}
+}
+
+static u0 rotate_by_reversals(umin *blk, usize bytes, usize pivot)
+{
+	reverse_bytes(blk, pivot);
+	reverse_bytes(blk + pivot, bytes - pivot);
+	reverse_bytes(blk, bytes);
+}
+
+static int compare_u64(const u0 *a, const u0 *b)
+{ return (*(const u64 *)a > *(const u64 *)b) - (*(const u64 *)a < *(const u64 *)b); }
+
+#define U64_LESS(A, B) (*(A) < *(B))
+DEFINE_SORT(sort_u64, u64, U64_LESS)
+DEFINE_SEARCH(search_u64, u64, U64_LESS)
+
+/// Fill with pseudo-random ids.
+static u0 random_ids(u64 *ids, usize n)
+{
+	u64 seed = 1;
+	for (usize i = 0; i < n; ++i) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		ids[i] = seed ^ (seed >> 29);
+	}
+}
+
+/// The byte-at-a-time hash maps used before, for comparison.
+static u64 djb2(MemSlice mem)
+{
+	u64 hash = 5381;
+	foreach (c, mem)
+		hash += c + (hash << 5);
+	return hash;
+}
+
+/// A per-record transform with a little work in it.
+static f64 score(u32 x) { return (f64)(x % 7) / (1.0 + (f64)(x & 255)) + x * 0.5; }
+#define ADD(A, B) ((A) + (B))
+#define IS_EVEN(X) ((X) % 2 == 0)
+
+newarray(U32Array, u32);
+DEFINE_ARRAY_OPS(U32Array, u32)
+
+static U32Array iota(usize n)
+{
+	U32Array xs = AMAKE(u32, n);
+	for (usize i = 0; i < n; ++i) PUSH(xs, i);
+	return xs;
+}
+
+ierr main(void)
+{
+	usize sizes[] = { 1000, 100000, 1000000, 10000000 };
+
+	BENCH("SHIFT and PUSH (as a queue) on u32 arrays") {
+		for (usize i = 0; i < COUNT(sizes); ++i) {
+			U32Array xs = iota(sizes[i]);
+			usize times = max(10000000 / sizes[i], (usize)10);
+			f64 ns = TIME(times, { u32 x = *SHIFT(xs); PUSH(xs, x); });
+			assert(xs.value[0] == times % sizes[i]);
+			println("%10zu elements: %12.1f ns/op, %6.2f GB/s",
+				sizes[i], ns, sizes[i] * sizeof(u32) / ns);
+			AFREE(xs);
+		}
+	}
+
+	BENCH("POP_FRONT and PUSH_BACK (as a queue) on u32 deques") {
+		for (usize i = 0; i < COUNT(sizes); ++i) {
+			dequeof(u32) xs = DMAKE(u32, sizes[i]);
+			for (u32 j = 0; j < sizes[i]; ++j) PUSH_BACK(xs, j);
+			usize times = 10000000;
+			f64 ns = TIME(times, { u32 x = *POP_FRONT(xs); PUSH_BACK(xs, x); });
+			assert(*DGET(xs, 0) == times % sizes[i]);
+			println("%10zu elements: %12.1f ns/op", sizes[i], ns);
+			DFREE(xs);
+		}
+	}
+
+	BENCH("REMOVE from the middle of u32 arrays") {
+		for (usize i = 0; i < COUNT(sizes); ++i) {
+			U32Array xs = iota(sizes[i]);
+			usize times = max(10000000 / sizes[i], (usize)10);
+			f64 ns = TIME(times, { REMOVE(xs, xs.len / 2); ++xs.len; });
+			println("%10zu elements: %12.1f ns/op", sizes[i], ns);
+			AFREE(xs);
+		}
+	}
+
+	BENCH("Rotating 64 MiB, memrotate against three reversals") {
+		usize bytes = 64 << 20;
+		umin *blk = emalloc(bytes, 1);
+		usize pivots[] = { 4, 1000, bytes / 3, bytes / 2, bytes - 4 };
+		for (usize i = 0; i < COUNT(pivots); ++i) {
+			f64 engine = TIME(4, memrotate(blk, bytes, pivots[i]));
+			f64 naive = TIME(4, rotate_by_reversals(blk, bytes, pivots[i]));
+			println("pivot %10zu: %8.2f ms, reversals %8.2f ms (%.1fx)",
+				pivots[i], engine * 1e-6, naive * 1e-6, naive / engine);
+		}
+		FREE(blk);
+	}
+
+	BENCH("Reversing 64 MiB, per element width against scalar swaps") {
+		usize bytes = 64 << 20;
+		umin *blk = emalloc(bytes, 1);
+		usize widths[] = { 1, 2, 4, 8, 16, 3, 24 };
+		for (usize i = 0; i < COUNT(widths); ++i) {
+			MemSlice elems = VIEW(MemSlice, blk, 0, bytes / widths[i]);
+			f64 kernel = TIME(4, reverse(&elems, widths[i]));
+			f64 scalar = TIME(4, reverse_scalar(blk, elems.len, widths[i]));
+			println("width %2zu: %8.2f ms, scalar %8.2f ms (%.1fx)",
+				widths[i], kernel * 1e-6, scalar * 1e-6, scalar / kernel);
+		}
+		FREE(blk);
+	}
+
+	BENCH("Byte-swapping 64 MiB into another buffer") {
+		usize bytes = 64 << 20;
+		umin *src = emalloc(bytes, 1), *dst = emalloc(bytes, 1);
+		usize widths[] = { 2, 4, 8, 16 };
+		for (usize i = 0; i < COUNT(widths); ++i) {
+			usize len = bytes / widths[i];
+			f64 kernel = TIME(4, byteswap(dst, src, len, widths[i]));
+			f64 scalar = TIME(4, byteswap_scalar(dst, src, len, widths[i]));
+			println("width %2zu: %8.2f ms (%5.2f GB/s), scalar %8.2f ms",
+				widths[i], kernel * 1e-6, bytes / kernel, scalar * 1e-6);
+		}
+		FREE(src);
+		FREE(dst);
+	}
+
+	BENCH("Pushing 10M integers: PUSH, U32Array_push and by hand") {
+		usize n = 10000000;
+		f64 generic = TIME(1, {
+			U32Array xs = AMAKE(u32, 16);
+			for (u32 i = 0; i < n; ++i) PUSH(xs, i);
+			AFREE(xs);
+		});
+		f64 special = TIME(1, {
+			U32Array xs = AMAKE(u32, 16);
+			for (u32 i = 0; i < n; ++i) U32Array_push(&xs, i);
+			AFREE(xs);
+		});
+		f64 manual = TIME(1, {
+			usize len = 0, cap = 16;
+			u32 *xs = malloc(cap * sizeof(u32));
+			for (u32 i = 0; i < n; ++i) {
+				if (len == cap) xs = realloc(xs, (cap *= 2) * sizeof(u32));
+				xs[len++] = i;
+			}
+			free(xs);
+		});
+		println("PUSH %.2f ns, U32Array_push %.2f ns, by hand %.2f ns (per push)",
+			generic / n, special / n, manual / n);
+	}
+
+	BENCH("Pushing and summing 10M integers: arrays against segmented arrays") {
+		usize n = 10000000;
+		u64 sum = 0;
+		f64 array = TIME(1, {
+			U32Array xs = AMAKE(u32, 16);
+			for (u32 i = 0; i < n; ++i) PUSH(xs, i);
+			FOR_EACH(x, xs) sum += x;
+			AFREE(xs);
+		});
+		f64 segmented = TIME(1, {
+			segmentedof(u32) xs = { 0 };
+			for (u32 i = 0; i < n; ++i) SEG_PUSH(xs, i);
+			SEG_FOR_EACH(x, xs) sum -= x;
+			SEG_FREE(xs);
+		});
+		assert(sum == 0);
+		println("array %.2f ns, segmented %.2f ns (per element)",
+			array / n, segmented / n);
+	}
+
+	BENCH("Intersecting and counting 64M flags: bitsets against bool arrays") {
+		usize n = 64 << 20;
+		Bitset a = BMAKE(n), b = BMAKE(n);
+		bool *x = emalloc(n, sizeof(bool)), *y = emalloc(n, sizeof(bool));
+		for (usize i = 0; i < n; i += 3) bitset_set(&a, i), x[i] = true;
+		for (usize i = 0; i < n; i += 5) bitset_set(&b, i), y[i] = true;
+		usize bits = 0, bools = 0;
+		f64 packed = TIME(4, { bitset_and(&a, &b); bits = bitset_count(&a); });
+		f64 plain = TIME(4, {
+			bools = 0;
+			for (usize i = 0; i < n; ++i) bools += x[i] &= y[i];
+		});
+		assert(bits == bools);
+		println("bitset %.2f ms, bool array %.2f ms (%.1fx, %zu set)",
+			packed * 1e-6, plain * 1e-6, plain / packed, bits);
+		BFREE(a); BFREE(b);
+		FREE(x); FREE(y);
+	}
+
+	BENCH("Sorting 10M random u64 ids: qsort, QSORT, DEFINE_SORT and RADIX_SORT") {
+		usize n = 10000000;
+		sliceof(u64) ids = SMAKE(u64, n);
+		f64 fill = TIME(1, random_ids(ids.value, n));
+		f64 libc = TIME(1, { random_ids(ids.value, n); qsort(ids.value, n, sizeof(u64), compare_u64); });
+		f64 generated = TIME(1, { random_ids(ids.value, n); QSORT(ids, compare_u64); });
+		f64 defined = TIME(1, { random_ids(ids.value, n); sort_u64(ids.value, n); });
+		f64 radix = TIME(1, { random_ids(ids.value, n); RADIX_SORT(ids); });
+		for (usize i = 1; i < n; ++i) assert(ids.value[i - 1] <= ids.value[i]);
+		println("qsort %.0f ms, QSORT %.0f ms, DEFINE_SORT %.0f ms, RADIX_SORT %.0f ms",
+			(libc - fill) * 1e-6, (generated - fill) * 1e-6,
+			(defined - fill) * 1e-6, (radix - fill) * 1e-6);
+		FREE(ids.value);
+	}
+
+	BENCH("Sorting 10M random u64 ids in parallel: PSORT speedup by threads") {
+		usize n = 10000000, cores = hardware_threads();
+		sliceof(u64) ids = SMAKE(u64, n);
+		f64 fill = TIME(1, random_ids(ids.value, n));
+		f64 serial = 0;
+		// Past the number of cores, only the split changes.
+		for (usize threads = 1; threads <= max(cores, (usize)4); threads *= 2) {
+			f64 t = TIME(1, { random_ids(ids.value, n); PSORT(ids, compare_u64, threads); }) - fill;
+			if (threads == 1) serial = t;
+			for (usize i = 1; i < n; ++i) assert(ids.value[i - 1] <= ids.value[i]);
+			println("%2zu thread(s): %.0f ms, %.2fx%s", threads, t * 1e-6, serial / t,
+				threads > cores ? " (more than the cores)" : "");
+		}
+		FREE(ids.value);
+	}
+
+	BENCH("Intersecting two sets of 1M sorted ids: a map against merging") {
+		usize n = 1000000;
+		sliceof(u64) a = SMAKE(u64, n), b = SMAKE(u64, n), small = SMAKE(u64, 1000);
+		random_ids(a.value, n);
+		random_ids(b.value, n);
+		for (usize i = 0; i < n; i += 2) b.value[i] = ~b.value[i];  // Half in common.
+		for (usize i = 0; i < small.len; ++i) small.value[i] = a.value[i * 997];
+		sort_u64(a.value, n);
+		sort_u64(b.value, n);
+		sort_u64(small.value, small.len);
+		arrayof(u64) out = AMAKE(u64, n);
+
+		f64 mapped = TIME(1, {
+			mapof(u64, bool) seen = MMAKE(u64, bool, n);
+			FOR_EACH(id, a) ASSOCIATE(seen, id, true);
+			CLEAR(out);
+			FOR_EACH(id, b) if (LOOKUP(seen, id) != nil) PUSH(out, id);
+			free_map(&seen);
+		});
+		usize common = out.len;
+		f64 merged = TIME(10, { out.len = search_u64_intersect(out.value, a.value, n, b.value, n); });
+		assert(out.len == common);
+		f64 generic = TIME(10, { CLEAR(out); SORTED_INTERSECT(out, a, b, compare_u64); });
+		assert(out.len == common);
+		f64 galloped = TIME(100, {
+			out.len = search_u64_intersect(out.value, small.value, small.len, b.value, n);
+		});
+		assert(search_u64_intersect(out.value, small.value, small.len, a.value, n) == small.len);
+		println("map %.1f ms, DEFINE_SEARCH %.2f ms (%.0fx), SORTED_INTERSECT %.2f ms; "
+			"%zu in common", mapped * 1e-6, merged * 1e-6, mapped / merged, generic * 1e-6, common);
+		println("1K against 1M, galloping: %.1f us", galloped * 1e-3);
+		AFREE(out);
+		FREE(a.value); FREE(b.value); FREE(small.value);
+	}
+
+	BENCH("Building and looking up 1M u64 ids: chained maps against tables") {
+		usize n = 1000000, found[2][2] = { 0 };
+		sliceof(u64) ids = SMAKE(u64, n);
+		random_ids(ids.value, n);
+		mapof(u64, u32) chained = MMAKE(u64, u32, n);
+		tableof(u64, u32) table = TMAKE(u64, u32, n);
+
+		f64 build[2] = {
+			TIME(1, for (usize i = 0; i < n; ++i) ASSOCIATE(chained, ids.value[i], (u32)i)),
+			TIME(1, for (usize i = 0; i < n; ++i) ASSOCIATE(table, ids.value[i], (u32)i))
+		};
+		f64 hits[2] = {
+			TIME(1, for (usize j = 0; j < n; ++j) found[0][0] += LOOKUP(chained, ids.value[j]) != nil),
+			TIME(1, for (usize j = 0; j < n; ++j) found[1][0] += LOOKUP(table, ids.value[j]) != nil)
+		};
+		f64 misses[2] = {
+			TIME(1, for (usize j = 0; j < n; ++j) found[0][1] += LOOKUP(chained, ~ids.value[j]) != nil),
+			TIME(1, for (usize j = 0; j < n; ++j) found[1][1] += LOOKUP(table, ~ids.value[j]) != nil)
+		};
+		assert(found[0][0] == n && found[1][0] == n);
+		assert(found[0][1] == found[1][1]);
+		f64 drops[2] = {
+			TIME(1, for (usize j = 0; j < n; ++j) DROP(chained, ids.value[j])),
+			TIME(1, for (usize j = 0; j < n; ++j) DROP(table, ids.value[j]))
+		};
+		assert(chained.len == 0 && table.len == 0);
+		byte *names[2] = { "mapof", "tableof" };
+		for (usize i = 0; i < 2; ++i)
+			println("%-8s build %.0f ms, hits %.0f ms, misses %.0f ms, drops %.0f ms",
+				names[i], build[i] * 1e-6, hits[i] * 1e-6, misses[i] * 1e-6, drops[i] * 1e-6);
+		free_map(&chained);
+		free_map(&table);
+		FREE(ids.value);
+	}
+
+	BENCH("Hashing keys: djb2 against hash_bytes, and sequential integers in maps") {
+		usize lens[] = { 8, 16, 32, 100, 4096 };
+		umin *text = emalloc(4096, 1);
+		for (usize i = 0; i < 4096; ++i) text[i] = 'a' + i % 26;
+		for (usize i = 0; i < COUNT(lens); ++i) {
+			MemSlice key = VIEW(MemSlice, text, 0, lens[i]);
+			usize times = 100000000 / lens[i];
+			u64 sum[2] = { 0 };
+			f64 old = TIME(times, { sum[0] += djb2(key); key.value[0] = sum[0]; });
+			f64 new = TIME(times, { sum[1] += hash_bytes(key); key.value[0] = sum[1]; });
+			assert(sum[0] != sum[1]);  //< used, so not optimised away.
+			println("%4zu bytes: djb2 %6.1f ns, hash_bytes %6.1f ns (%5.2f GB/s)",
+				lens[i], old, new, lens[i] / new);
+		}
+		FREE(text);
+
+		usize n = 2000000;
+		u32 found = 0;
+		for (usize mixed = 0; mixed < 2; ++mixed) {
+			mapof(u64, u32) map = MMAKE(u64, u32, n);
+			unless (mixed) map.hasher = upcast_hash;
+			f64 build = TIME(1, for (u64 j = 0; j < n; ++j) ASSOCIATE(map, j * 1024, (u32)j));
+			f64 hits = TIME(1, for (u64 j = 0; j < n; ++j) found += *LOOKUP(map, j * 1024) == j);
+			println("%s: build %.0f ms, lookup %.0f ms, %zu of %zu buckets used",
+				mixed ? "integer_hash" : "upcast_hash ", build * 1e-6, hits * 1e-6,
+				map.buckets.len, map.buckets.cap);
+			free_map(&map);
+		}
+		assert(found == 2 * n);
+	}
+
+	BENCH("Summing the values of a 1M entry map: KEYS and LOOKUP against FOR_EACH_ENTRY") {
+		usize n = 1000000;
+		sliceof(u64) ids = SMAKE(u64, n);
+		random_ids(ids.value, n);
+		mapof(u64, u32) map = MMAKE(u64, u32, n);
+		tableof(u64, u32) table = TMAKE(u64, u32, n);
+		for (usize j = 0; j < n; ++j) {
+			ASSOCIATE(map, ids.value[j], (u32)j);
+			ASSOCIATE(table, ids.value[j], (u32)j);
+		}
+		u64 sums[3] = { 0 };
+		f64 keyed = TIME(1, {
+			sliceof(u64) *keys = KEYS(map);
+			for (usize j = 0; j < keys->len; ++j) sums[0] += *LOOKUP(map, keys->value[j]);
+			FREE_INSIDE(*keys);
+		});
+		f64 chained = TIME(1, FOR_EACH_VALUE(v, map) sums[1] += v);
+		f64 open = TIME(1, FOR_EACH_VALUE(v, table) sums[2] += v);
+		assert(sums[0] == sums[1] && sums[1] == sums[2]);
+		usize present = 0, next = 0;
+		f64 member = TIME(n, present += HAS_KEY(map, ids.value[next++]));
+		assert(present == n);
+		println("KEYS and LOOKUP %.1f ms, FOR_EACH_ENTRY %.1f ms (table %.1f ms); "
+			"HAS_KEY %.0f ns", keyed * 1e-6, chained * 1e-6, open * 1e-6, member);
+		free_map(&map);
+		free_map(&table);
+		FREE(ids.value);
+	}
+
+	BENCH("Building and looking up 8M ids: one at a time against in bulk, with prefetching") {
+		usize n = 8000000;
+		newslice(U64Slice, u64);
+		newslice(U32Slice, u32);
+		U64Slice ids = SMAKE(u64, n);
+		U32Slice values = SMAKE(u32, n);
+		random_ids(ids.value, n);
+		for (usize j = 0; j < n; ++j) values.value[j] = j;
+		u32 **found = emalloc(n, sizeof(u32 *));
+		for (usize engine = 0; engine < 2; ++engine) {
+			mapof(u64, u32) map = MMAKE(u64, u32, 16);
+			tableof(u64, u32) table = TMAKE(u64, u32, 16);
+			usize hits[2] = { 0 };
+			f64 single[2], bulk[2];
+			if (engine == 0) {
+				single[0] = TIME(1, for (usize j = 0; j < n; ++j) ASSOCIATE(map, ids.value[j], values.value[j]));
+				single[1] = TIME(1, for (usize j = 0; j < n; ++j) hits[0] += LOOKUP(map, ids.value[j]) != nil);
+				free_map(&map);
+				map = (typeof(map))MMAKE(u64, u32, 16);
+				bulk[0] = TIME(1, ASSOCIATE_MANY(map, ids, values));
+				bulk[1] = TIME(1, hits[1] = LOOKUP_MANY(map, ids, found));
+			} else {
+				single[0] = TIME(1, for (usize j = 0; j < n; ++j) ASSOCIATE(table, ids.value[j], values.value[j]));
+				single[1] = TIME(1, for (usize j = 0; j < n; ++j) hits[0] += LOOKUP(table, ids.value[j]) != nil);
+				free_map(&table);
+				table = (typeof(table))TMAKE(u64, u32, 16);
+				bulk[0] = TIME(1, ASSOCIATE_MANY(table, ids, values));
+				bulk[1] = TIME(1, hits[1] = LOOKUP_MANY(table, ids, found));
+			}
+			assert(hits[0] == n && hits[1] == n && *found[n / 2] == n / 2);
+			println("%-8s build %.0f ms, ASSOCIATE_MANY %.0f ms; lookups %.0f ms, LOOKUP_MANY %.0f ms",
+				engine ? "tableof" : "mapof", single[0] * 1e-6, bulk[0] * 1e-6,
+				single[1] * 1e-6, bulk[1] * 1e-6);
+			free_map(&map);
+			free_map(&table);
+		}
+		FREE(found);
+		FREE(ids.value);
+		FREE(values.value);
+	}
+
+	BENCH("Inserting 1M and 4M ids one at a time: resizing maps at once against incrementally") {
+		usize n = 4000000;
+		sliceof(u64) ids = SMAKE(u64, n), latencies = SMAKE(u64, n);
+		random_ids(ids.value, n);
+		for (usize size = n / 4; size <= n; size *= 4)
+		for (usize incremental = 0; incremental < 2; ++incremental) {
+			// With the default allocator, so the new buckets must be zeroed.
+			mapof(u64, u32) map = MMAKE(u64, u32, 16);
+			map.incremental = incremental;
+			f64 total = TIME(1, for (usize j = 0; j < size; ++j) {
+				f64 start = now();
+				ASSOCIATE(map, ids.value[j], (u32)j);
+				latencies.value[j] = (now() - start) * 1e9;
+			});
+			sort_u64(latencies.value, size);
+			println("%zuM %-13s total %.0f ms, p99 %llu ns, p99.99 %llu ns, worst %.3f ms",
+				size / 1000000, incremental ? "incremental" : "all at once", total * 1e-6,
+				latencies.value[size / 100 * 99], latencies.value[size / 10000 * 9999],
+				latencies.value[size - 1] * 1e-6);
+			free_map(&map);
+		}
+		FREE(ids.value);
+		FREE(latencies.value);
+	}
+
+	BENCH("Transforming 20M records: SMAP against PMAP, PREDUCE, PSCAN and PPARTITION") {
+		usize n = 20000000;
+		newslice(F64Slice, f64);
+		U32Array xs = iota(n);
+		F64Slice scores;
+		f64 serial_map = TIME(1, { scores = SMAP(F64Slice, score, xs); FREE(scores.value); });
+		f64 parallel_map = TIME(1, { scores = PMAP(F64Slice, score, xs); });
+		f64 total = 0, reduced = 0;
+		f64 serial_sum = TIME(1, FOR_EACH(x, scores) total += x);
+		f64 parallel_sum = TIME(1, { reduced = PREDUCE(scores, 0.0, ADD); });
+		f64 scan = TIME(1, PSCAN(scores, 0.0, ADD));
+		f64 partition = TIME(1, PPARTITION(xs, IS_EVEN));
+		println("on %zu thread(s): SMAP %.0f ms, PMAP %.0f ms (%.2fx)",
+			workers_default()->count + 1, serial_map * 1e-6, parallel_map * 1e-6,
+			serial_map / parallel_map);
+		println("sum %.0f ms, PREDUCE %.0f ms (%.2fx, %.3g against %.3g)",
+			serial_sum * 1e-6, parallel_sum * 1e-6, serial_sum / parallel_sum, reduced, total);
+		println("PSCAN %.0f ms, PPARTITION %.0f ms", scan * 1e-6, partition * 1e-6);
+		AFREE(xs);
+		FREE(scores.value);
+	}
+
+	BENCH("Building short strings: AMAKE against SMALL_ARRAY") {
+		usize n = 1000000;
+		f64 heap = TIME(n, {
+			StringBuilder s = AMAKE(byte, 16);
+			for (byte c = 'a'; c < 'a' + 40; ++c) PUSH(s, c);
+			AFREE(s);
+		});
+		f64 small = TIME(n, {
+			SMALL_ARRAY(s, byte, 64);
+			for (byte c = 'a'; c < 'a' + 40; ++c) PUSH(s, c);
+			AFREE(s);
+		});
+		println("AMAKE %.1f ns, SMALL_ARRAY %.1f ns (per 40-byte string)", heap, small);
+	}
+
+	return 0;
+}
@@ -0,0 +1,158 @@
+#include "arena.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+static u0 *arena_allocator_alloc(u0 *context, usize bytes)
+{ return arena_alloc(context, bytes); }
+
+static u0 *arena_allocator_realloc(u0 *context, u0 *ptr, usize old_bytes, usize new_bytes)
+{ return arena_realloc(context, ptr, old_bytes, new_bytes); }
+
+static u0 arena_allocator_free(u0 *context, u0 *ptr, usize bytes)
+{
+	UNUSED(bytes);
+	Arena *arena = context;
+	// Only the last allocation can be given back.
+	unless (ptr == arena->last) return UNIT;
+	arena->current->used = (umin *)ptr - arena->current->data;
+	arena->last = nil;
+}
+
+static inline usize align_up(usize n)
+{ return (n + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1); }
+
+static ArenaChunk *new_chunk(usize size)
+{
+	ArenaChunk *chunk = allocate(nil, sizeof(ArenaChunk) + size);
+	if (chunk == nil)
+		PANIC("Could not allocate arena chunk of %zu bytes.", size);
+	chunk->next = nil;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+u0 arena_init(Arena *arena, usize chunk_size)
+{
+	arena->first = arena->current = nil;
+	arena->chunk_size = align_up(max(chunk_size, (usize)ARENA_ALIGNMENT));
+	arena->last = nil;
+	arena->allocator = (Allocator){
+		.alloc = arena_allocator_alloc,
+		.realloc = arena_allocator_realloc,
+		.free = arena_allocator_free,
+		.context = arena
+	};
+}
+
+u0 *arena_alloc(Arena *arena, usize bytes)
+{
+	bytes = align_up(bytes);
+	ArenaChunk *chunk = arena->current;
+
+	unless (chunk != nil && chunk->size - chunk->used >= bytes) {
+		// Move on to the next kept chunk, if it is big enough,
+		// otherwise splice a fresh chunk in after the current one.
+		ArenaChunk *next = chunk == nil ? arena->first : chunk->next;
+		if (next == nil || next->size < bytes) {
+			ArenaChunk *fresh = new_chunk(max(arena->chunk_size, bytes));
+			fresh->next = next;
+			if (chunk == nil) arena->first = fresh;
+			else chunk->next = fresh;
+			next = fresh;
+		}
+		next->used = 0;
+		chunk = arena->current = next;
+	}
+
+	u0 *ptr = chunk->data + chunk->used;
+	chunk->used += bytes;
+	arena->last = ptr;
+	return ptr;
+}
+
+u0 *arena_realloc(Arena *arena, u0 *ptr, usize old_bytes, usize new_bytes)
+{
+	if (ptr == nil) return arena_alloc(arena, new_bytes);
+
+	if (ptr == arena->last) {  // Grow or shrink in-place, if it fits.
+		ArenaChunk *chunk = arena->current;
+		usize offset = (umin *)ptr - chunk->data;
+		usize bytes = align_up(new_bytes);
+		if (chunk->size - offset >= bytes) {
+			chunk->used = offset + bytes;
+			return ptr;
+		}
+	} else if (new_bytes <= old_bytes) {
+		return ptr;  // Shrinking something in the middle; keep it.
+	}
+
+	u0 *new = arena_alloc(arena, new_bytes);
+	memcpy(new, ptr, min(old_bytes, new_bytes));
+	return new;
+}
+
+ArenaMark arena_mark(Arena *arena)
+{
+	ArenaChunk *chunk = arena->current;
+	return ((ArenaMark){
+		.chunk = chunk,
+		.used = chunk == nil ? 0 : chunk->used
+	});
+}
+
+u0 arena_rewind(Arena *arena, ArenaMark mark)
+{
+	if (mark.chunk == nil) {
+		arena_reset(arena);
+		return UNIT;
+	}
+	arena->current = mark.chunk;
+	arena->current->used = mark.used;
+	arena->last = nil;
+}
+
+u0 arena_reset(Arena *arena)
+{
+	arena->current = arena->first;
+	if (arena->current != nil)
+		arena->current->used = 0;
+	arena->last = nil;
+}
+
+u0 arena_free(Arena *arena)
+{
+	ArenaChunk *chunk = arena->first;
+	until (chunk == nil) {
+		ArenaChunk *next = chunk->next;
+		deallocate(nil, chunk, sizeof(ArenaChunk) + chunk->size);
+		chunk = next;
+	}
+	arena->first = arena->current = nil;
+	arena->last = nil;
+}
+
+usize arena_used(const Arena *arena)
+{
+	usize used = 0;
+	for (ArenaChunk *chunk = arena->first; chunk != nil; chunk = chunk->next) {
+		used += chunk->used;
+		if (chunk == arena->current) break;
+	}
+	return used;
+}
+
+static _Thread_local Arena scratch = { 0 };
+
+Arena *scratch_arena()
+{
+	if (scratch.chunk_size == 0)
+		arena_init(&scratch, SCRATCH_CHUNK_SIZE);
+	return &scratch;
+}
+
+u0 scratch_free()
+{ arena_free(&scratch); }
+
+#endif
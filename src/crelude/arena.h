@@ -0,0 +1,84 @@
+//! @file arena.h
+//! Arena (linear bump) allocator for short-lived data.
+//! Everything allocated from an arena is freed at once, by
+//! resetting or rewinding it, instead of one `FREE` at a time.
+//! e.g.
+//! ```c
+//! Arena arena;
+//! arena_init(&arena, ARENA_CHUNK_SIZE);
+//!
+//! StringBuilder sb = AMAKE_WITH(byte, 16, &arena.allocator);
+//! string s = sprint_with(&arena.allocator, "%d + %d", 1, 2);
+//! mapof(string, i32) map = MMAKE_WITH(string, i32, 8, &arena.allocator);
+//! ...
+//! arena_reset(&arena);  //< frees all of the above.
+//! ```
+
+#pragma once
+#include "common.h"
+
+/// Default size of an arena chunk, in bytes.
+#define ARENA_CHUNK_SIZE (64 * 1024)
+/// Size of the chunks of each thread's scratch arena.
+#define SCRATCH_CHUNK_SIZE (16 * 1024)
+/// Every allocation is aligned to (at least) this many bytes.
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+/// Block of memory which allocations are bumped out of.
+record(ArenaChunk) {
+	ArenaChunk *next;
+	usize size;  ///< Bytes available in `data`.
+	usize used;  ///< Bytes already handed out from `data`.
+	_Alignas(max_align_t) umin data[];
+};
+
+record(Arena) {
+	ArenaChunk *first;    ///< Chunks are kept after a reset, for reuse.
+	ArenaChunk *current;  ///< Chunk currently being bumped.
+	usize chunk_size;     ///< Minimum size of newly allocated chunks.
+	u0 *last;  ///< Last allocation, which can be grown/freed in-place.
+	/// Allocator interface to this arena, to be carried by arrays, maps,
+	/// etc., or given to `eallocate`, `novel_sprintf_with`, and so on.
+	/// Its `free` only reclaims memory for the very last allocation.
+	Allocator allocator;
+};
+
+/// A position in the arena that can be rewound to.
+record(ArenaMark) {
+	ArenaChunk *chunk;
+	usize used;
+};
+
+/// Initialise an arena.  No memory is allocated until first use.
+/// @param[out] arena The arena, which must not move after this.
+/// @param[in] chunk_size Minimum size of each chunk, e.g. `ARENA_CHUNK_SIZE`.
+extern u0 arena_init(Arena *arena, usize chunk_size);
+/// Bump-allocate `bytes` from the arena (uninitialised).
+/// Panics when out of memory.
+extern u0 *arena_alloc(Arena *arena, usize bytes);
+/// Resize an allocation.  In-place if it is the last allocation made.
+extern u0 *arena_realloc(Arena *arena, u0 *ptr, usize old_bytes, usize new_bytes);
+/// Record the current position in the arena.
+extern ArenaMark arena_mark(Arena *arena);
+/// Free everything allocated since `mark` was taken.
+extern u0 arena_rewind(Arena *arena, ArenaMark mark);
+/// Free everything in the arena, in O(1).  Chunks are kept for reuse.
+extern u0 arena_reset(Arena *arena);
+/// Give all chunks back to the system.  The arena may be used again.
+extern u0 arena_free(Arena *arena);
+/// Total number of bytes currently handed out by the arena.
+extern usize arena_used(const Arena *arena);
+
+/// The calling thread's scratch arena, for temporaries.  Take a mark
+/// before using it, and rewind to it as soon as they are done with,
+/// such that its chunks are reused, and only grow when needed.
+/// ```c
+/// Arena *scratch = scratch_arena();
+/// ArenaMark mark = arena_mark(scratch);
+/// byte *tmp = arena_alloc(scratch, n);
+/// ...
+/// arena_rewind(scratch, mark);
+/// ```
+extern Arena *scratch_arena(void);
+/// Give the calling thread's scratch memory back to the system.
+extern u0 scratch_free(void);
@@ -25,7 +25,7 @@ usize base64_decoded_size(MemSlice encoded)
 	return size;
 }
 
-MemSlice base64_encode(MemSlice data)
+MemSlice (base64_encode)(MemSlice data)
 {
 	if (data.len == 0 || PTR(data) == nil)
 		return EMPTY(MemSlice);
@@ -55,7 +55,7 @@ MemSlice base64_encode(MemSlice data)
 	return out;
 }
 
-MemSlice base64_decode(MemSlice data)
+MemSlice (base64_decode)(MemSlice data)
 {
 	if (data.len == 0 || PTR(data) == nil)
 		return EMPTY(MemSlice);
@@ -59,3 +59,8 @@ MemSlice base64_encode(MemSlice);
 /// an empty nil-slice will be returned.
 /// @returns A heap allocated slice holding the raw decoded data.
 MemSlice base64_decode(MemSlice);
+
+#ifdef CRELUDE_PROFILE
+	#define base64_encode(...) PROFILE_CALL(base64_encode, __VA_ARGS__)
+	#define base64_decode(...) PROFILE_CALL(base64_decode, __VA_ARGS__)
+#endif
@@ -0,0 +1,199 @@
+#include "bitset.h"
+#include "simd.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+/// Mask of the bits in use in the last word of a set of `bits` bits.
+static inline u64 tail_mask(usize bits)
+{
+	usize used = bits % BITSET_WORD_BITS;
+	return used == 0 ? ~(u64)0 : ((u64)1 << used) - 1;
+}
+
+/// Clear the bits past the end, as the other operations assume.
+static inline u0 trim(Bitset *set)
+{
+	unless (set->len == 0)
+		set->words[bitset_words(set->len) - 1] &= tail_mask(set->len);
+}
+
+Bitset (bitset_make)(usize bits, Allocator *allocator)
+{
+	return (Bitset){
+		.words = eallocate(allocator, max(bitset_words(bits), (usize)1), sizeof(u64)),
+		.len = bits,
+		.alloc = allocator
+	};
+}
+
+u0 (bitset_resize)(Bitset *set, usize bits)
+{
+	usize old_words = max(bitset_words(set->len), (usize)1);
+	usize new_words = max(bitset_words(bits), (usize)1);
+	unless (old_words == new_words) {
+		u64 *words = reallocate(set->alloc, set->words,
+			old_words * sizeof(u64), new_words * sizeof(u64));
+		if (words == nil)
+			PANIC("Could not reallocate %zu bytes.", new_words * sizeof(u64));
+		if (new_words > old_words)
+			zero(words + old_words, (new_words - old_words) * sizeof(u64));
+		set->words = words;
+	}
+	set->len = bits;
+	trim(set);
+}
+
+u0 bitset_free(Bitset *set)
+{
+	deallocate(set->alloc, set->words,
+		max(bitset_words(set->len), (usize)1) * sizeof(u64));
+	set->words = nil;
+	set->len = 0;
+}
+
+u0 bitset_fill(Bitset *set, usize from, usize upto, bool value)
+{
+	upto = min(upto, set->len);
+	if (from >= upto) return UNIT;
+
+	usize first = from / BITSET_WORD_BITS, last = (upto - 1) / BITSET_WORD_BITS;
+	u64 head = ~(u64)0 << (from % BITSET_WORD_BITS);
+	u64 tail = tail_mask(upto);
+	if (first == last) head &= tail;
+
+	u64 *words = set->words;
+	if (value) {
+		words[first] |= head;
+		unless (first == last) {
+			memset(words + first + 1, 0xFF, (last - first - 1) * sizeof(u64));
+			words[last] |= tail;
+		}
+	} else {
+		words[first] &= ~head;
+		unless (first == last) {
+			memset(words + first + 1, 0x00, (last - first - 1) * sizeof(u64));
+			words[last] &= ~tail;
+		}
+	}
+}
+
+usize popcount_words(const u64 *words, usize len)
+{
+	usize i = 0, count = 0;
+#if SIMD_WIDTH > 0
+	const usize lanes = SIMD_WIDTH / sizeof(u64);
+	vec sums = vec_zero();
+	// Byte counts of four vectors (at most 32 each) are added up
+	// before being widened into the 64-bit sums.
+	for (; i + 4 * lanes <= len; i += 4 * lanes) {
+		vec bytes = vec_add8(
+			vec_add8(vec_popcount8(vec_load(words + i)),
+			         vec_popcount8(vec_load(words + i + lanes))),
+			vec_add8(vec_popcount8(vec_load(words + i + 2 * lanes)),
+			         vec_popcount8(vec_load(words + i + 3 * lanes))));
+		sums = vec_add64(sums, vec_sum_bytes64(bytes));
+	}
+	for (; i + lanes <= len; i += lanes)
+		sums = vec_add64(sums, vec_sum_bytes64(vec_popcount8(vec_load(words + i))));
+	u64 lane[SIMD_WIDTH / sizeof(u64)];
+	vec_store(lane, sums);
+	for (usize j = 0; j < lanes; ++j) count += lane[j];
+#endif
+	for (; i < len; ++i) count += popcount_word(words[i]);
+	return count;
+}
+
+usize bitset_count(const Bitset *set)
+{ return popcount_words(set->words, bitset_words(set->len)); }
+
+usize bitset_next(const Bitset *set, usize from)
+{
+	if (from >= set->len) return set->len;
+	usize words = bitset_words(set->len);
+	usize i = from / BITSET_WORD_BITS;
+	u64 word = set->words[i] & (~(u64)0 << (from % BITSET_WORD_BITS));
+	until (word != 0) {
+		if (++i == words) return set->len;
+		word = set->words[i];
+	}
+	return i * BITSET_WORD_BITS + __builtin_ctzll(word);
+}
+
+bool bitset_none(const Bitset *set)
+{ return is_zeroed(set->words, bitset_words(set->len) * sizeof(u64)); }
+
+/// Combine `LEN` words of `SRC` into `DST`, with `VOP` a vector at
+/// a time, and with `OP` for the remaining words.
+#define BITWISE_KERNEL(VOP, OP, DST, SRC, LEN) do { \
+	u64 *_dst = (DST); \
+	const u64 *_src = (SRC); \
+	usize _i = 0; \
+	BITWISE_VECTORS(VOP, _dst, _src, _i, LEN); \
+	for (; _i < (LEN); ++_i) _dst[_i] = OP(_dst[_i], _src[_i]); \
+} while (0)
+
+#if SIMD_WIDTH > 0
+	#define BITWISE_VECTORS(VOP, DST, SRC, I, LEN) do { \
+		const usize _lanes = SIMD_WIDTH / sizeof(u64); \
+		for (; I + _lanes <= LEN; I += _lanes) \
+			vec_store(DST + I, VOP(vec_load(DST + I), vec_load(SRC + I))); \
+	} while (0)
+#else
+	#define BITWISE_VECTORS(VOP, DST, SRC, I, LEN) UNUSED(I)
+#endif
+
+#define WORD_AND(A, B)    ((A) & (B))
+#define WORD_OR(A, B)     ((A) | (B))
+#define WORD_XOR(A, B)    ((A) ^ (B))
+#define WORD_ANDNOT(A, B) ((A) & ~(B))
+
+/// Number of words that both sets have.
+static inline usize shared_words(const Bitset *self, const Bitset *other)
+{ return min(bitset_words(self->len), bitset_words(other->len)); }
+
+u0 bitset_and(Bitset *self, const Bitset *other)
+{
+	usize shared = shared_words(self, other);
+	BITWISE_KERNEL(vec_and, WORD_AND, self->words, other->words, shared);
+	// Bits that `other` does not have are clear.
+	zero(self->words + shared, (bitset_words(self->len) - shared) * sizeof(u64));
+	trim(self);
+}
+
+u0 bitset_or(Bitset *self, const Bitset *other)
+{
+	BITWISE_KERNEL(vec_or, WORD_OR,
+		self->words, other->words, shared_words(self, other));
+	trim(self);
+}
+
+u0 bitset_xor(Bitset *self, const Bitset *other)
+{
+	BITWISE_KERNEL(vec_xor, WORD_XOR,
+		self->words, other->words, shared_words(self, other));
+	trim(self);
+}
+
+u0 bitset_andnot(Bitset *self, const Bitset *other)
+{
+	BITWISE_KERNEL(vec_andnot, WORD_ANDNOT,
+		self->words, other->words, shared_words(self, other));
+}
+
+MemSlice bitset_bytes(const Bitset *set)
+{
+	return VIEW(MemSlice, (umin *)set->words, 0,
+		bitset_words(set->len) * sizeof(u64));
+}
+
+Bitset bitset_view(MemSlice bytes, usize bits)
+{
+	assert(bytes.len % sizeof(u64) == 0 && (uptr)bytes.value % _Alignof(u64) == 0);
+	assert(bitset_words(bits) * sizeof(u64) <= bytes.len);
+	Bitset set = { .words = (u64 *)bytes.value, .len = bits };
+	trim(&set);
+	return set;
+}
+
+#endif
@@ -0,0 +1,88 @@
+//! @file bitset.h
+//! Compact sets of bits, packed 64 to a word (instead of one `bool`
+//! per byte), with whole-set operations done a vector at a time.
+//! e.g.
+//! ```c
+//! Bitset seen = BMAKE(1000);
+//! bitset_set(&seen, 42);
+//! bitset_fill(&seen, 100, 200, true);
+//! BITSET_FOR_EACH(i, seen) println("%zu is set", i);
+//! MemSlice bytes = bitset_bytes(&seen);  //< e.g. to write to a file.
+//! BFREE(seen);
+//! ```
+
+#pragma once
+#include "common.h"
+
+#define BITSET_WORD_BITS 64
+
+record(Bitset) {
+	u64 *words; ///< Bits past `len` (in the last word) are always zero.
+	usize len;  ///< Number of bits.
+	Allocator *alloc;  ///< `nil` means the default allocator.
+};
+
+/// Number of words holding `bits` bits.
+static inline usize bitset_words(usize bits)
+{ return (bits + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS; }
+
+static inline bool bitset_get(const Bitset *set, usize i)
+{ return set->words[i / BITSET_WORD_BITS] >> (i % BITSET_WORD_BITS) & 1; }
+
+static inline u0 bitset_set(Bitset *set, usize i)
+{ set->words[i / BITSET_WORD_BITS] |= (u64)1 << (i % BITSET_WORD_BITS); }
+
+static inline u0 bitset_clear(Bitset *set, usize i)
+{ set->words[i / BITSET_WORD_BITS] &= ~((u64)1 << (i % BITSET_WORD_BITS)); }
+
+static inline u0 bitset_flip(Bitset *set, usize i)
+{ set->words[i / BITSET_WORD_BITS] ^= (u64)1 << (i % BITSET_WORD_BITS); }
+
+/// Allocate a set of `bits` bits, all clear.
+extern Bitset bitset_make(usize bits, Allocator *);
+/// Change the number of bits, new ones being clear.
+extern u0 bitset_resize(Bitset *, usize bits);
+extern u0 bitset_free(Bitset *);
+/// Set (or clear) every bit in `[from, upto)`.
+extern u0 bitset_fill(Bitset *, usize from, usize upto, bool value);
+/// Number of set bits.
+extern usize bitset_count(const Bitset *);
+/// Number of set bits in `len` words, a vector at a time.
+extern usize popcount_words(const u64 *words, usize len);
+/// Index of the first set bit at or after `from`, or `len` if none.
+extern usize bitset_next(const Bitset *, usize from);
+/// Whether no bit is set.
+extern bool bitset_none(const Bitset *);
+
+/// In-place `self &= other`.  Where `other` is shorter, its
+/// missing bits count as clear (likewise for the following).
+extern u0 bitset_and(Bitset *self, const Bitset *other);
+/// In-place `self |= other`.
+extern u0 bitset_or(Bitset *self, const Bitset *other);
+/// In-place `self ^= other`.
+extern u0 bitset_xor(Bitset *self, const Bitset *other);
+/// In-place `self &= ~other`, i.e. set difference.
+extern u0 bitset_andnot(Bitset *self, const Bitset *other);
+
+/// The words of the set, as bytes (in the host's byte order),
+/// without copying.  Always a whole number of words.
+extern MemSlice bitset_bytes(const Bitset *);
+/// A set of `bits` bits over `bytes` (e.g. from `bitset_bytes`),
+/// without copying.  The bytes must be aligned to, and a whole number
+/// of, words.  The set borrows them, so must not be freed or resized.
+/// Any bits past `bits`, in the last word, are cleared.
+extern Bitset bitset_view(MemSlice bytes, usize bits);
+
+#ifdef CRELUDE_PROFILE
+	#define bitset_make(...)   PROFILE_CALL(bitset_make, __VA_ARGS__)
+	#define bitset_resize(...) PROFILE_CALL_U0(bitset_resize, __VA_ARGS__)
+#endif
+
+#define BMAKE(BITS) bitset_make((BITS), nil)
+#define BMAKE_WITH(BITS, ALLOC) bitset_make((BITS), (ALLOC))
+#define BFREE(SET) bitset_free(&(SET))
+
+/// Loop over the indices of the set bits, in increasing order.
+#define BITSET_FOR_EACH(INDEX, SET) \
+	for (usize INDEX = bitset_next(&(SET), 0); INDEX < (SET).len; \
+	     INDEX = bitset_next(&(SET), INDEX + 1))
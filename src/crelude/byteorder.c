@@ -0,0 +1,53 @@
+#include "byteorder.h"
+#include "simd.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+static inline u128 bswap128(u128 n)
+{
+	return (u128)__builtin_bswap64((u64)n) << 64
+	     | __builtin_bswap64((u64)(n >> 64));
+}
+
+/// Swap `len` elements of type `T` with `BSWAP`, a vector at a time first.
+#define BYTESWAP_KERNEL(T, BSWAP, DST, SRC, LEN) do { \
+	T *_dst = (T *)(DST); \
+	const T *_src = (const T *)(SRC); \
+	usize _i = 0; \
+	BYTESWAP_VECTORS(T, _dst, _src, _i, LEN); \
+	for (; _i < (LEN); ++_i) { \
+		T _n; \
+		memcpy(&_n, _src + _i, sizeof(T)); \
+		_n = BSWAP(_n); \
+		memcpy(_dst + _i, &_n, sizeof(T)); \
+	} \
+} while (0)
+
+#if SIMD_WIDTH > 0
+	#define BYTESWAP_VECTORS(T, DST, SRC, I, LEN) do { \
+		const usize _lanes = SIMD_WIDTH / sizeof(T); \
+		for (; I + 2 * _lanes <= LEN; I += 2 * _lanes) { \
+			vec _a = vec_load(SRC + I), _b = vec_load(SRC + I + _lanes); \
+			vec_store(DST + I, vec_byteswap(_a, sizeof(T))); \
+			vec_store(DST + I + _lanes, vec_byteswap(_b, sizeof(T))); \
+		} \
+	} while (0)
+#else
+	#define BYTESWAP_VECTORS(T, DST, SRC, I, LEN) UNUSED(DST, SRC, I)
+#endif
+
+u0 byteswap(u0 *dst, const u0 *src, usize len, usize width)
+{
+	switch (width) {
+	case 1:  if (dst != src) memcpy(dst, src, len); break;
+	case 2:  BYTESWAP_KERNEL(u16,  __builtin_bswap16, dst, src, len); break;
+	case 4:  BYTESWAP_KERNEL(u32,  __builtin_bswap32, dst, src, len); break;
+	case 8:  BYTESWAP_KERNEL(u64,  __builtin_bswap64, dst, src, len); break;
+	case 16: BYTESWAP_KERNEL(u128, bswap128,          dst, src, len); break;
+	default:
+		PANIC("Cannot byte-swap elements of %zu bytes.", width);
+	}
+}
+
+#endif
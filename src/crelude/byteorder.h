@@ -0,0 +1,73 @@
+//! @file byteorder.h
+//! Bulk byte-order conversion of numeric arrays and slices,
+//! for elements of 2, 4, 8 or 16 bytes (`u16` ... `u128`).
+//! Converting between the host's own byte order and itself
+//! compiles to nothing (or a copy, when not done in-place).
+//! e.g.
+//! ```c
+//! newslice(Samples, u32);
+//! Samples samples = VIEW(Samples, (u32 *)record, 0, count);
+//! FROM_BIG_ENDIAN(samples);  //< in-place, to host byte order.
+//! ```
+
+#pragma once
+#include "common.h"
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	#define HOST_BIG_ENDIAN 1
+#else
+	#define HOST_BIG_ENDIAN 0
+#endif
+
+/// Reverse the bytes of every element.
+/// @param[out] dst Where to write the swapped elements, may be `src`.
+/// @param[in] src The elements to swap, not overlapping `dst` (unless equal).
+/// @param[in] len Number of elements.
+/// @param[in] width Size of each element: 2, 4, 8 or 16 bytes.
+extern u0 byteswap(u0 *dst, const u0 *src, usize len, usize width);
+
+/// Convert elements from big endian to host byte order.  See `byteswap`.
+static inline u0 from_big_endian(u0 *dst, const u0 *src, usize len, usize width)
+{
+	if (HOST_BIG_ENDIAN) {
+		if (dst != src) memcpy(dst, src, len * width);
+	} else {
+		byteswap(dst, src, len, width);
+	}
+}
+
+/// Convert elements from little endian to host byte order.  See `byteswap`.
+static inline u0 from_little_endian(u0 *dst, const u0 *src, usize len, usize width)
+{
+	if (HOST_BIG_ENDIAN) {
+		byteswap(dst, src, len, width);
+	} else {
+		if (dst != src) memcpy(dst, src, len * width);
+	}
+}
+
+/// Convert elements from host byte order to big endian.
+#define to_big_endian from_big_endian
+/// Convert elements from host byte order to little endian.
+#define to_little_endian from_little_endian
+
+/// In-place byte swapping of every element in an array or slice.
+#define BYTESWAP(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   byteswap(_self->value, _self->value, _self->len, sizeof(*_self->value)); \
+	   *_self; })
+
+#define FROM_BIG_ENDIAN(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   from_big_endian(_self->value, _self->value, \
+	       _self->len, sizeof(*_self->value)); \
+	   *_self; })
+
+#define FROM_LITTLE_ENDIAN(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   from_little_endian(_self->value, _self->value, \
+	       _self->len, sizeof(*_self->value)); \
+	   *_self; })
+
+#define TO_BIG_ENDIAN FROM_BIG_ENDIAN
+#define TO_LITTLE_ENDIAN FROM_LITTLE_ENDIAN
@@ -1,6 +1,8 @@
 #include "common.h"
 #include "io.h"
 #include "utf.h"
+#include "simd.h"
+#include "table.h"
 
 #include <assert.h>
 
@@ -22,6 +24,22 @@ bool is_zerof(f64 n)
 bool is_zeroed(u0 *ptr, usize width)
 {
 	umin *xs = (umin *)ptr;
+#if SIMD_WIDTH > 0
+	// Four vectors at a time, checking them all at once.
+	for (; width >= 4 * SIMD_WIDTH; width -= 4 * SIMD_WIDTH, xs += 4 * SIMD_WIDTH) {
+		vec v = vec_or(
+			vec_or(vec_load(xs), vec_load(xs + SIMD_WIDTH)),
+			vec_or(vec_load(xs + 2 * SIMD_WIDTH), vec_load(xs + 3 * SIMD_WIDTH)));
+		unless (vec_is_zero(v)) return false;
+	}
+	for (; width >= SIMD_WIDTH; width -= SIMD_WIDTH, xs += SIMD_WIDTH)
+		unless (vec_is_zero(vec_load(xs))) return false;
+#endif
+	for (; width >= WORD_SIZE; width -= WORD_SIZE, xs += WORD_SIZE) {
+		uword word;
+		memcpy(&word, xs, WORD_SIZE);
+		unless (word == 0) return false;
+	}
 	until (width-- == 0) unless (*xs++ == 0) return false;
 	return true;
 }
@@ -30,34 +48,214 @@ u0 zero(u0 *blk, usize width)
 {
 	if (blk == nil || width == 0)
 		return UNIT;
-	umin *bytes = blk;
-	until (width-- == 0)
-		*bytes++ = 0;
+	// The C library's `memset` already picks the widest stores
+	// (and non-temporal ones for huge blocks) for this machine.
+	memset(blk, 0, width);
 	return UNIT;
 }
 
-u0 *emalloc(usize len, usize size)
+static u0 *global_alloc(u0 *context, usize bytes)
+{
+	UNUSED(context);
+	return MALLOC(bytes);
+}
+
+static u0 *global_realloc(u0 *context, u0 *ptr, usize old_bytes, usize new_bytes)
+{
+	UNUSED(context, old_bytes);
+	return REALLOC(ptr, new_bytes);
+}
+
+static u0 global_free(u0 *context, u0 *ptr, usize bytes)
+{
+	UNUSED(context, bytes);
+	FREE(ptr);
+}
+
+Allocator GLOBAL_ALLOCATOR = {
+	.alloc = global_alloc,
+	.realloc = global_realloc,
+	.free = global_free,
+	.context = nil
+};
+
+static u0 *small_alloc(u0 *context, usize bytes)
+{
+	UNUSED(context);
+	return allocate(nil, bytes);
+}
+
+static u0 *small_realloc(u0 *context, u0 *ptr, usize old_bytes, usize new_bytes)
+{
+	UNUSED(context);
+	// Never resized in place, the old block is inside the array itself.
+	u0 *new = allocate(nil, new_bytes);
+	unless (new == nil)
+		memcpy(new, ptr, min(old_bytes, new_bytes));
+	return new;
+}
+
+static u0 small_free(u0 *context, u0 *ptr, usize bytes)
+{
+	UNUSED(context, ptr, bytes);
+}
+
+Allocator SMALL_BUFFER = {
+	.alloc = small_alloc,
+	.realloc = small_realloc,
+	.free = small_free,
+	.context = nil
+};
+
+u0 *(allocate)(Allocator *allocator, usize bytes)
+{
+	Allocator *a = or(allocator, &GLOBAL_ALLOCATOR);
+	return a->alloc(a->context, bytes);
+}
+
+u0 *(reallocate)(Allocator *allocator, u0 *ptr, usize old_bytes, usize new_bytes)
+{
+	Allocator *a = or(allocator, &GLOBAL_ALLOCATOR);
+	if (ptr == nil)
+		return a->alloc(a->context, new_bytes);
+	if (new_bytes == 0) {
+		a->free(a->context, ptr, old_bytes);
+		return nil;
+	}
+	return a->realloc(a->context, ptr, old_bytes, new_bytes);
+}
+
+u0 deallocate(Allocator *allocator, u0 *ptr, usize bytes)
+{
+	if (ptr == nil) return UNIT;
+	Allocator *a = or(allocator, &GLOBAL_ALLOCATOR);
+	a->free(a->context, ptr, bytes);
+}
+
+u0 *(eallocate)(Allocator *allocator, usize len, usize size)
 {
 	usize bytes = len * size;
-	u0 *m = MALLOC(bytes);
+	u0 *m = allocate(allocator, bytes);
 	if (m == nil)
 		PANIC("Could not allocate %zu bytes.", bytes);
-	zero(m, bytes);
+	unless (allocator != nil && allocator->zeroed)
+		zero(m, bytes);
 	return m;
 }
 
+u0 *(emalloc)(usize len, usize size)
+{ return eallocate(nil, len, size); }
+
+u0 *pool_take(NodePool *pool, usize node_size, Allocator *allocator)
+{
+	assert(node_size >= sizeof(u0 *));
+	if (pool->free == nil) {  // Carve a new slab up into free nodes.
+		usize nodes = max(pool->slab_nodes, (usize)POOL_SLAB_MIN_NODES);
+		usize offset = max(sizeof(PoolSlab), _Alignof(max_align_t));
+		usize bytes = offset + nodes * node_size;
+		PoolSlab *slab = allocate(allocator, bytes);
+		if (slab == nil)
+			PANIC("Could not allocate %zu bytes.", bytes);
+		slab->next = pool->slabs;
+		slab->bytes = bytes;
+		pool->slabs = slab;
+		pool->slab_nodes = min(2 * nodes, (usize)POOL_SLAB_MAX_NODES);
+
+		umin *node = (umin *)slab + offset;
+		for (usize i = 0; i < nodes; ++i, node += node_size)
+			pool_give(pool, node);
+	}
+
+	u0 *node = pool->free;
+	pool->free = *(u0 **)node;
+	return node;
+}
+
+u0 pool_give(NodePool *pool, u0 *node)
+{
+	*(u0 **)node = pool->free;
+	pool->free = node;
+}
+
+u0 pool_release(NodePool *pool, Allocator *allocator)
+{
+	PoolSlab *slab = pool->slabs;
+	until (slab == nil) {
+		PoolSlab *next = slab->next;
+		deallocate(allocator, slab, slab->bytes);
+		slab = next;
+	}
+	pool->free = pool->slabs = nil;
+	pool->slab_nodes = 0;
+}
+
+/// Reverse `len` elements of type `T`, swapping vectors (with their
+/// lanes reversed) from either end, then single elements in the middle.
+#define REVERSE_KERNEL(T, PTR, LEN) do { \
+	T *_elems = (T *)(PTR); \
+	usize _i = 0, _j = (LEN); \
+	REVERSE_VECTORS(T, _elems, _i, _j); \
+	for (; _i + 1 < _j--; ++_i) { \
+		T _tmp = _elems[_i]; \
+		_elems[_i] = _elems[_j]; \
+		_elems[_j] = _tmp; \
+	} \
+} while (0)
+
+/// Reverse a few bytes, where the vector code would not pay off.
+#define REVERSE_BYTES(PTR, WIDTH) do { \
+	umin *_bytes = (PTR); \
+	for (usize _i = 0, _j = (WIDTH); _i + 1 < _j--; ++_i) { \
+		umin _tmp = _bytes[_i]; \
+		_bytes[_i] = _bytes[_j]; \
+		_bytes[_j] = _tmp; \
+	} \
+} while (0)
+
+#if SIMD_WIDTH > 0
+	#define REVERSE_VECTORS(T, ELEMS, I, J) do { \
+		const usize _lanes = SIMD_WIDTH / sizeof(T); \
+		for (; J - I >= 2 * _lanes; I += _lanes, J -= _lanes) { \
+			vec _front = vec_load(ELEMS + I); \
+			vec _back  = vec_load(ELEMS + J - _lanes); \
+			vec_store(ELEMS + I, vec_reverse(_back, sizeof(T))); \
+			vec_store(ELEMS + J - _lanes, vec_reverse(_front, sizeof(T))); \
+		} \
+	} while (0)
+#else
+	#define REVERSE_VECTORS(T, ELEMS, I, J) UNUSED(ELEMS, I, J)
+#endif
+
 /* in-place */
 u0 reverse(u0 *self, usize width)
 {
-	umin chunk[width];  //< C99 variable-length array.
 	MemArray *arr = self;
 	umin *ptr = arr->value;
-	usize len = arr->len * width;
-
-	for (usize i = 0, j = len - 1; i < j; ++i, --j) {
-		memcpy(  chunk, ptr + i, width);
-		memcpy(ptr + i, ptr + j, width);
-		memcpy(ptr + j,   chunk, width);
+	usize len = arr->len;
+
+	switch (width) {
+	case 1:  REVERSE_KERNEL(u8,  ptr, len); break;
+	case 2:  REVERSE_KERNEL(u16, ptr, len); break;
+	case 4:  REVERSE_KERNEL(u32, ptr, len); break;
+	case 8:  REVERSE_KERNEL(u64, ptr, len); break;
+	case 16:  // Elements fill (half) a vector, so just swap them.
+		for (usize i = 0, j = len; i + 1 < j--; ++i) {
+			u128 tmp;
+			memcpy(&tmp, ptr + i * 16, 16);
+			memcpy(ptr + i * 16, ptr + j * 16, 16);
+			memcpy(ptr + j * 16, &tmp, 16);
+		}
+		break;
+	default:
+		if (width > 16) {  // Wide elements are swapped as blocks.
+			for (usize i = 0, j = len; i + 1 < j--; ++i)
+				memswap(ptr + i * width, ptr + j * width, width);
+			break;
+		}
+		// Reverse all the bytes, then the bytes within each element.
+		REVERSE_KERNEL(u8, ptr, len * width);
+		for (usize i = 0; i < len; ++i)
+			REVERSE_BYTES(ptr + i * width, width);
 	}
 
 	return UNIT;
@@ -67,13 +265,7 @@ MemSlice reverse_endianness(MemSlice bytes)
 {
 	MemSlice copy;
 	copy = COPY(bytes);
-
-	for (usize i = 0, j = copy.len - 1; i < j; ++i, --j) {
-		umin temp = NTH(copy, i);
-		NTH(copy, i) = NTH(copy, j);
-		NTH(copy, j) = temp;
-	}
-
+	reverse(&copy, 1);
 	return copy;
 }
 
@@ -86,94 +278,101 @@ bool is_little_endian()
 u128 big_endian(umin *start, usize bytes)
 {
 	assert(bytes <= sizeof(u128));
-	// Write to offset in word (big endian), then reverse
-	// depending on endianess. i.e., [0x32][0xF1] becomes:
-	//   [0x00][0x00][0x32][0xF1]  (big endian), or
-	//   [0xF1][0x32][0x00][0x00]  (little endian)
-	umin mem[sizeof(u128)];
-	memset(mem, 0, sizeof(u128));
-	memcpy(mem + sizeof(u128) - bytes, start, bytes);
-
-	MemSlice reversed = VIEW(MemSlice, mem, 0, sizeof(u128));
-	if (is_little_endian())  // reverse `mem` if little endian.
-		reverse(&reversed, 1);
-
-	return *(u128 *)mem;
+	// Load into the end of a (big endian) 128-bit word, i.e.
+	//   [0x32][0xF1] becomes [0x00]...[0x00][0x32][0xF1],
+	// then swap the bytes of each half, if we are little endian.
+	u64 halves[2] = { 0, 0 };
+	memcpy((umin *)halves + sizeof(u128) - bytes, start, bytes);
+
+	if (is_little_endian())
+		return (u128)__builtin_bswap64(halves[0]) << 64
+		     | __builtin_bswap64(halves[1]);
+	return (u128)halves[0] << 64 | halves[1];
 }
 
 u0 memswap(umin *a, umin *b, usize bytes)
 {
-	usize words = bytes / WORD_SIZE;
-	usize trail = words * WORD_SIZE;  //< Where left-over bytes start.
-
-	// Swap word sized blocks first.
-	for (usize i = 0; i < words; i += WORD_SIZE) {
+	usize i = 0;
+#if SIMD_WIDTH > 0
+	// Swap two vectors from each side at a time.
+	for (; i + 2 * SIMD_WIDTH <= bytes; i += 2 * SIMD_WIDTH) {
+		vec a0 = vec_load(a + i), a1 = vec_load(a + i + SIMD_WIDTH);
+		vec b0 = vec_load(b + i), b1 = vec_load(b + i + SIMD_WIDTH);
+		vec_store(a + i, b0), vec_store(a + i + SIMD_WIDTH, b1);
+		vec_store(b + i, a0), vec_store(b + i + SIMD_WIDTH, a1);
+	}
+	for (; i + SIMD_WIDTH <= bytes; i += SIMD_WIDTH) {
+		vec va = vec_load(a + i), vb = vec_load(b + i);
+		vec_store(a + i, vb), vec_store(b + i, va);
+	}
+#endif
+	// Swap word sized blocks next.
+	for (; i + WORD_SIZE <= bytes; i += WORD_SIZE) {
 		uword tmp;
 		memcpy( &tmp, a + i, WORD_SIZE);
 		memcpy(a + i, b + i, WORD_SIZE);
 		memcpy(b + i,  &tmp, WORD_SIZE);
 	}
 	// Swap remaining bytes, byte-by-byte.
-	for (usize i = trail; i < bytes; ++i) {
+	for (; i < bytes; ++i) {
 		umin tmp = a[i];
 		a[i] = b[i];
 		b[i] = tmp;
 	}
 }
 
-/// # Swapping memory (on pivot point `b`):
+/// # Rotating memory (on pivot point `b`):
+/// When the smaller block fits in `ROTATE_BUFFER_SIZE` bytes, it is put
+/// aside on the stack while the larger block is moved (with `memmove`).
+/// Otherwise, equally sized blocks are swapped to shrink the problem:
 /// ```
 ///    a       b     c       d
 ///    |---A---:------B------|
 /// == |---A---:--B1-:---B2--|
 /// => |---B2--:--B1-:---A---|
-/// => |--B1-:---B2--:---A---|  (by same procedure, recursive)
+/// => |--B1-:---B2--:---A---|  (by same procedure, on [a, c))
 /// == |------B------:---A---|
 /// ```
 /// When swapping block A and B.
-/// Notice the pivot remains the same (b) for each recursive call.
-/// (a, b, and c are pointers, and do not change).
+/// Notice the pivot remains the same (b) for each step.
 ///
-/// When the pivot point is `c`,
-/// i.e. when block A is the larger block, we have:
+/// When block A is the larger block, we have:
 /// ```
 ///    a       b     c       d
 ///    |------A------:---B---|
 /// == |---A1--:--A2-:---B---|
 /// => |---B---:--A2-:--A1---|
-/// => |---B---:--A1---:--A2-|  (by same procedure, recursive)
+/// => |---B---:--A1---:--A2-|  (by same procedure, on [b, d))
 /// == |---B---:------A------|
 /// ```
-static u0 swap_blocks(MemSlice block, usize pivot)
-{  // Tail-recursion should be optimised here.
-	if (pivot == 0 || pivot == block.len)
-		return;  // We are already done.
-
-	MemSlice A = SLICE(MemSlice, block, 0, pivot);
-	MemSlice B = SLICE(MemSlice, block, pivot, -1);
-	MemSlice A1, A2;
-	MemSlice B1, B2;
-
-	if (A.len < B.len) {
-		B1 = SLICE(MemSlice, B, 0, -A.len - 1);
-		B2 = SLICE(MemSlice, B, B1.len, -1);
-		assert(A.len == B2.len);
-
-		memswap(A.value, B2.value, A.len);
-		B = SLICE(MemSlice, block, 0, B.len);
-		swap_blocks(B, pivot);
-	} else if (A.len > B.len) {
-		A1 = SLICE(MemSlice, A, 0, B.len);
-		A2 = SLICE(MemSlice, A, A1.len, -1);
-		assert(B.len == A1.len);
-		assert(pivot == A1.len + A2.len);
-
-		memswap(B.value, A1.value, B.len);
-		A = SLICE(MemSlice, block, B.len, -1);
-		swap_blocks(A, pivot - B.len);
-	} else {
-		// Same length, and thus trivial.
-		memswap(A.value, B.value, A.len);
+/// Each step swaps whole blocks front to back, which streams through
+/// memory, and moves every byte about once (unlike three reversals).
+u0 memrotate(umin *blk, usize bytes, usize pivot)
+{
+	umin buffer[ROTATE_BUFFER_SIZE];
+	usize left = pivot, right = bytes - pivot;
+
+	until (left == 0 || right == 0) {
+		if (left <= ROTATE_BUFFER_SIZE && left <= right) {
+			memcpy(buffer, blk, left);
+			memmove(blk, blk + left, right);
+			memcpy(blk + right, buffer, left);
+			return UNIT;
+		}
+		if (right <= ROTATE_BUFFER_SIZE) {
+			memcpy(buffer, blk + left, right);
+			memmove(blk + right, blk, left);
+			memcpy(blk, buffer, right);
+			return UNIT;
+		}
+		if (left <= right) {
+			memswap(blk, blk + right, left);
+			right -= left;
+		} else {
+			memswap(blk, blk + left, right);
+			blk += right;
+			left -= right;
+		}
 	}
 }
 
@@ -182,37 +381,44 @@ u0 swap(u0 *self, usize pivot, usize width)
 	// Deal with everything in terms of bytes.
 	MemSlice blk = *(MemSlice *)self;
 	blk.len *= width;
-	usize pos = pivot * width;
-	swap_blocks(blk, pos);
+	memrotate(blk.value, blk.len, pivot * width);
 }
 
-usize resize(u0 *self, usize cap, usize width)
+usize (resize)(u0 *self, usize cap, usize width)
 {
 	MemArray *arr = self;
 	if (arr->cap == cap)
 		return arr->cap - arr->len;
-	// Lowering the capacity; best done by REALLOC.
-	if (cap < arr->cap) {
-		arr->value = REALLOC(arr->value, cap * width);
-	} else {  // Growing the capacity; must zero bytes.
-		umin *new = emalloc(cap, width);
-		memcpy(new, arr->value, arr->cap * width);
-		FREE(arr->value);
-		arr->value = new;
-	}
+	// Small arrays keep their inline buffer until they outgrow it.
+	bool spill = arr->alloc == &SMALL_BUFFER;
+	if (spill && cap < arr->cap)
+		return arr->cap - arr->len;
+
+	umin *new = reallocate(arr->alloc, arr->value, arr->cap * width, cap * width);
+	if (new == nil && cap > 0)
+		PANIC("Could not reallocate %zu bytes.", cap * width);
+	if (spill) arr->alloc = nil;
+	// Growing the capacity; must zero the new bytes.
+	if (cap > arr->cap && !(arr->alloc != nil && arr->alloc->zeroed))
+		zero(new + arr->cap * width, (cap - arr->cap) * width);
+	arr->value = new;
 
 	arr->cap = cap;
 	return arr->cap - arr->len;
 }
 
-usize grow(u0 *self, usize count, usize width)
+usize (grow)(u0 *self, usize count, usize width)
 {
 	MemArray *arr = self;
 	usize old_cap = arr->cap;
 	usize new_cap = arr->cap;
 
 	if (arr->len + count > arr->cap) {  // reallocate array.
-		new_cap = (usize)(arr->cap * ARRAY_REALLOC_FACTOR) + count;
+		if (arr->growth == nil)
+			new_cap = (usize)(arr->cap * ARRAY_REALLOC_FACTOR) + count;
+		else
+			new_cap = max(arr->len + count, arr->growth->capacity(
+				arr->growth, arr->cap, arr->len + count, width));
 		resize(arr, new_cap, width);
 	}
 
@@ -220,6 +426,63 @@ usize grow(u0 *self, usize count, usize width)
 	return new_cap - old_cap;
 }
 
+usize growth_geometric(const GrowthPolicy *policy, usize cap, usize needed, usize width)
+{
+	UNUSED(width);
+	return max((usize)(cap * policy->factor), needed);
+}
+
+usize growth_pow2(const GrowthPolicy *policy, usize cap, usize needed, usize width)
+{
+	UNUSED(policy, cap, width);
+	if (needed <= 1) return 1;
+	return (usize)1 << (sizeof(usize) * CHAR_BIT - __builtin_clzl(needed - 1));
+}
+
+usize growth_pages(const GrowthPolicy *policy, usize cap, usize needed, usize width)
+{
+	UNUSED(policy);
+	static usize page = 0;
+	if (page == 0) page = sysconf(_SC_PAGESIZE);
+	usize bytes = max((usize)(cap * ARRAY_REALLOC_FACTOR), needed) * width;
+	bytes = (bytes + page - 1) / page * page;
+	return bytes / width;
+}
+
+usize growth_fixed(const GrowthPolicy *policy, usize cap, usize needed, usize width)
+{
+	UNUSED(cap, width);
+	usize step = max(policy->step, (usize)1);
+	return (needed + step - 1) / step * step;
+}
+
+const GrowthPolicy GROWTH_DOUBLING = { .capacity = growth_geometric, .factor = 2 };
+const GrowthPolicy GROWTH_POW2 = { .capacity = growth_pow2 };
+const GrowthPolicy GROWTH_PAGES = { .capacity = growth_pages };
+
+usize reserve(u0 *self, usize count, usize width)
+{
+	MemArray *arr = self;
+	if (arr->len + count <= arr->cap) return 0;
+	usize old_cap = arr->cap;
+	resize(arr, arr->len + count, width);
+	return arr->cap - old_cap;
+}
+
+usize shrink_to_fit(u0 *self, usize width)
+{
+	MemArray *arr = self;
+	usize old_cap = arr->cap;
+	resize(arr, arr->len, width);
+	return old_cap - arr->cap;
+}
+
+u0 clear(u0 *self)
+{
+	MemArray *arr = self;
+	arr->len = 0;
+}
+
 u0 *get(u0 *self, usize index, usize width)
 {
 	MemArray *arr = self;
@@ -237,7 +500,7 @@ u0 *set(u0 *self, usize index, const u0 *elem, usize width)
 	return arr->value + index * width;
 }
 
-usize push(u0 *restrict self, const u0 *restrict element, usize width)
+usize (push)(u0 *restrict self, const u0 *restrict element, usize width)
 {
 	if (element == nil) return 0;
 
@@ -249,7 +512,7 @@ usize push(u0 *restrict self, const u0 *restrict element, usize width)
 	return growth;
 }
 
-usize insert(u0 *restrict self, usize index,
+usize (insert)(u0 *restrict self, usize index,
              const u0 *restrict element, usize width)
 {
 	if (element == nil) return 0;
@@ -268,7 +531,7 @@ usize insert(u0 *restrict self, usize index,
 	return growth;
 }
 
-usize extend(u0 *restrict self, const u0 *restrict slice, usize width)
+usize (extend)(u0 *restrict self, const u0 *restrict slice, usize width)
 {
 	if (slice == nil) return 0;
 
@@ -284,7 +547,7 @@ usize extend(u0 *restrict self, const u0 *restrict slice, usize width)
 	return growth;
 }
 
-usize splice(u0 *restrict self, usize index, const u0 *restrict slice, usize width)
+usize (splice)(u0 *restrict self, usize index, const u0 *restrict slice, usize width)
 {
 	if (slice == nil) return 0;
 
@@ -328,7 +591,7 @@ GenericSlice cut(u0 *self, usize from, isize upto, usize width)
 	pivot *= width;
 
 	MemSlice tail = SLICE(MemSlice, arr, from, arr.len);
-	swap_blocks(tail, pivot);
+	memrotate(tail.value, tail.len, pivot);
 	tail = SLICE(MemSlice, tail, tail.len - pivot, -1);
 
 	u0 *tail_ptr = &tail;
@@ -407,16 +670,54 @@ i16 string_cmp(const string self, const string other)
 	return ptr0[len] - 0;
 }
 
-/// `djb2` hash-algo.
-u64 hash_bytes(MemSlice mem)
-{
-	u64 hash = 5381;
-	foreach (c, mem)
-		hash += c + (hash << 5);
+static inline u64 read_u64(const umin *ptr)
+{ u64 word; memcpy(&word, ptr, sizeof(u64)); return word; }
+static inline u64 read_u32(const umin *ptr)
+{ u32 word; memcpy(&word, ptr, sizeof(u32)); return word; }
 
-	return hash;
+/// `wyhash` hash-algo, taking 16 bytes per step (48 for long keys,
+/// in three independent lanes).
+u64 hash_bytes_seeded(MemSlice mem, u64 seed)
+{
+	const umin *ptr = mem.value;
+	usize len = mem.len;
+	u64 a = 0, b = 0;
+	seed ^= hash_mix(seed ^ HASH_SECRET_0, HASH_SECRET_1);
+
+	if (len <= 16) {
+		if (len >= 4) {  // two (maybe overlapping) pairs of u32s.
+			usize mid = (len >> 3) << 2;
+			a = read_u32(ptr) << 32 | read_u32(ptr + mid);
+			b = read_u32(ptr + len - 4) << 32 | read_u32(ptr + len - 4 - mid);
+		} else if (len > 0) {
+			a = (u64)ptr[0] << 16 | (u64)ptr[len >> 1] << 8 | ptr[len - 1];
+		}
+	} else {
+		usize left = len;
+		if (left > 48) {
+			u64 seed1 = seed, seed2 = seed;
+			do {
+				seed  = hash_mix(read_u64(ptr)      ^ HASH_SECRET_1, read_u64(ptr +  8) ^ seed);
+				seed1 = hash_mix(read_u64(ptr + 16) ^ HASH_SECRET_2, read_u64(ptr + 24) ^ seed1);
+				seed2 = hash_mix(read_u64(ptr + 32) ^ HASH_SECRET_3, read_u64(ptr + 40) ^ seed2);
+				ptr += 48;
+				left -= 48;
+			} while (left > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		for (; left > 16; left -= 16, ptr += 16)
+			seed = hash_mix(read_u64(ptr) ^ HASH_SECRET_1, read_u64(ptr + 8) ^ seed);
+		// the last 16 bytes (overlapping what came before).
+		a = read_u64(ptr + left - 16);
+		b = read_u64(ptr + left - 8);
+	}
+	hash_multiply(a ^ HASH_SECRET_1, b ^ seed, &a, &b);
+	return hash_mix(a ^ HASH_SECRET_0 ^ len, b ^ HASH_SECRET_1);
 }
 
+u64 hash_bytes(MemSlice mem)
+{ return hash_bytes_seeded(mem, 0); }
+
 u64 hash_string(string str)
 { return hash_bytes(TO_BYTES(str)); }
 
@@ -445,6 +746,13 @@ static u0 *node_next(const u0 *self, const u0 *node)
 	return (umin *)node + map->next_offset;
 }
 
+/// Hash of a key, which is never zero (as that marks an empty bucket).
+static u64 key_hash(const GenericMap *map, const u0 *key)
+{
+	u64 hash = map->hasher(key, map->key_size);
+	return hash == 0 ? 1 : hash;
+}
+
 /// Get bucket index given key.
 static usize bucket_index(const u0 *self, u64 hash)
 {
@@ -454,7 +762,7 @@ static usize bucket_index(const u0 *self, u64 hash)
 
 // TODO: right now we check proper equality, maybe just use the hash,
 //       and don't worry about hash-collisions?  `u64` is quite large after all.
-static bool key_eq(const u0 *self, const u0 *key0, const u0 *key1)
+bool map_keys_equal(const u0 *self, const u0 *key0, const u0 *key1)
 {
 	if (key0 == key1) return true;
 	const GenericMap *map = self;
@@ -493,20 +801,132 @@ usize init_hashnode(u0 *node, const u0 *_map, u64 hash, const u0 *key, const u0
 	return map->node_size;
 }
 
-u0 associate(u0 *self, const u0 *key, const u0 *value)
+/// Whether the map is part way through an incremental resize.
+static bool is_resizing(const GenericMap *map)
+{ return PTR(map->old_buckets) != nil; }
+
+/// The bucket array holding the chain for `hash`, and its first node,
+/// which is in the `old_buckets` while they have not been moved.
+static MemArray *home_bucket(GenericMap *map, u64 hash, u0 **head)
+{
+	if (is_resizing(map)) {
+		usize index = (usize)hash % map->old_buckets.cap;
+		if (index >= map->moved) {
+			*head = PTR(map->old_buckets) + index * map->node_size;
+			return &map->old_buckets;
+		}
+	}
+	*head = (umin *)PTR(map->buckets) + bucket_index(map, hash) * map->node_size;
+	return (MemArray *)&map->buckets;
+}
+
+/// Move the chain in the `index`th of the `old_buckets` into `buckets`.
+static u0 move_bucket(GenericMap *map, usize index)
 {
-	GenericMap *map = self;
 	const usize NODE_SIZE = map->node_size;
+	u0 *node = PTR(map->old_buckets) + index * NODE_SIZE;
+	if (node_hash(map, node) == 0) return UNIT;
+
+	u0 *next = nil;
+	for (bool first = true; node != nil; node = next, first = false) {
+		next = *(u0 **)node_next(map, node);
+		u0 *bucket = (umin *)PTR(map->buckets)
+		           + bucket_index(map, node_hash(map, node)) * NODE_SIZE;
+		if (node_hash(map, bucket) == 0) {  // start a chain in the bucket.
+			memcpy(bucket, node, NODE_SIZE);
+			*(u0 **)node_next(map, bucket) = nil;
+			++map->buckets.len;
+			unless (first)  // we have a copy (the head lived in the old buckets).
+				pool_give(&map->pool, node);
+			continue;
+		}
+		// otherwise, link it in after the bucket's node,
+		// putting it on the heap if it lived in the old buckets.
+		u0 *link = node;
+		if (first) {
+			link = pool_take(&map->pool, NODE_SIZE, map->buckets.alloc);
+			memcpy(link, node, NODE_SIZE);
+		}
+		u0 **bucket_next = node_next(map, bucket);
+		*(u0 **)node_next(map, link) = *bucket_next;
+		*bucket_next = link;
+	}
+	--map->old_buckets.len;
+	return UNIT;
+}
 
-	u64 hash = map->hasher(key, map->key_size);
-	usize index = bucket_index(map, hash);
+/// Move at most `count` more of the `old_buckets`,
+/// and free them once they all have been.  Any of the new buckets may
+/// be moved into, so they are all zeroed first, so many per old bucket
+/// that they are done well before the old buckets have filled up.
+static u0 move_buckets(GenericMap *map, usize count)
+{
+	unless (is_resizing(map)) return UNIT;
+	if (map->cleared < map->buckets.cap) {
+		usize ratio = map->buckets.cap / map->old_buckets.cap + 1;
+		usize left = map->buckets.cap - map->cleared;
+		usize steps = min(count, left / ratio + 1);
+		usize clear = min(steps * ratio, left);
+		zero((umin *)PTR(map->buckets) + map->cleared * map->node_size,
+		     clear * map->node_size);
+		map->cleared += clear;
+		if (map->cleared < map->buckets.cap) return UNIT;
+	}
+	usize upto = map->moved + min(count, map->old_buckets.cap - map->moved);
+	for (; map->moved < upto; ++map->moved)
+		move_bucket(map, map->moved);
+	if (map->moved < map->old_buckets.cap) return UNIT;
+
+	assert(map->old_buckets.len == 0);
+	deallocate(map->buckets.alloc, PTR(map->old_buckets),
+	           map->old_buckets.cap * map->node_size);
+	map->old_buckets = AEMPTY(MemArray);
+	map->moved = 0;
+	return UNIT;
+}
+
+/// Re-index the whole map into `cap` buckets.  Growing the array means
+/// hash-values are modulo'd to different values, and so every chain is
+/// re-arranged: all at once, or (if the map is `incremental`) a few
+/// buckets at a time by the following `associate`, `lookup` and `drop`s.
+static u0 resize_buckets(GenericMap *map, usize cap)
+{
+	move_buckets(map, SIZE_MAX);  //< finish any resize still under way.
+	memcpy(&map->old_buckets, &map->buckets, sizeof(MemArray));
+	Allocator *allocator = map->buckets.alloc;
+	// with no old buckets, there is nothing to do a bit at a time.
+	bool gradual = map->incremental && map->old_buckets.cap > 0;
+	if (gradual) {  // zeroed by the following `move_buckets`.
+		usize bytes = cap * map->node_size;
+		map->buckets.value = allocate(allocator, bytes);
+		if (map->buckets.value == nil)
+			PANIC("Could not allocate %zu bytes.", bytes);
+		map->cleared = allocator != nil && allocator->zeroed ? cap : 0;
+	} else {
+		map->buckets.value = eallocate(allocator, cap, map->node_size);
+		map->cleared = cap;
+	}
+	map->buckets.cap = cap;
+	map->buckets.len = 0;  //< counts populated buckets.
+	map->moved = 0;
+	unless (gradual)
+		move_buckets(map, SIZE_MAX);
+	return UNIT;
+}
 
-	u0 *head = (umin *)PTR(map->buckets) + index * NODE_SIZE;
+/// Associate a key (with the given hash) with a value, in a chained map.
+static u0 associate_hashed(GenericMap *map, u64 hash, const u0 *key, const u0 *value)
+{
+	const usize NODE_SIZE = map->node_size;
+	if (map->buckets.cap == 0)  // e.g. made by `MMAKE(K, V, 0)`.
+		resize_buckets(map, 1);
+	u0 *head;
+	MemArray *buckets = home_bucket(map, hash, &head);
 	u0 *node = head;  /*< type of `hashnode(K, V)`. */
 	u0 *last = nil;
 	// Walk up node-chain trying to find if key is already present.
 	until (node == nil || node_hash(map, node) == 0) {  // zero-hash = unpopulated.
-		if (key_eq(map, node_key(map, node), key)) {
+		if (map_keys_equal(map, node_key(map, node), key)) {
 			// Found node with equal key, so rewrite value.
 			memcpy(node_value(map, node), value, map->value_size);
 			return UNIT;
@@ -518,15 +938,13 @@ u0 associate(u0 *self, const u0 *key, const u0 *value)
 	assert(node == nil || node_hash(map, node) == 0);
 	++map->len;
 
-	u0 *new = emalloc(1, NODE_SIZE);
-	init_hashnode(new, map, hash, key, value);
-
 	if (last == nil) {  // i.e. chain hasn't started.
 		assert(node == head);
-		memcpy(head, new, NODE_SIZE);
-		grow(&map->buckets, 1, NODE_SIZE);
-		FREE(new);
+		init_hashnode(head, map, hash, key, value);
+		++buckets->len;
 	} else {  // otherwise, make the node part of the linked list.
+		u0 *new = pool_take(&map->pool, NODE_SIZE, map->buckets.alloc);
+		init_hashnode(new, map, hash, key, value);
 		u0 **last_next = node_next(map, last);
 		assert(*last_next == nil);
 		*last_next = new;
@@ -538,69 +956,35 @@ u0 associate(u0 *self, const u0 *key, const u0 *value)
 	// ^ if load factor (entries per potential bucket) gets over ~85%,
 	// we should ~double it in capacity, preventing the linked lists
 	// from getting to long, and lookup time too slow.
+	resize_buckets(map,
+	               CEIL(usize, HASHMAP_GROWTH_FACTOR
+	                 * (LOAD_FACTOR / HASHMAP_LOAD_THRESHOLD)
+	                 * map->buckets.cap));
+	return UNIT;
+}
 
-	/// re-index whole array.  Growing the array means hash-values
-	/// are modulo'd to different values, and so we need to re-arrange.
-	GenericArray snodes = AMAKE(umin[NODE_SIZE], map->len);
-	for (usize i = 0; i < map->buckets.cap; ++i) {
-		u0 *snode = (umin *)PTR(map->buckets) + i * NODE_SIZE;
-		if (node_hash(map, snode) == 0) continue;
-		bool first = true;
-		until (snode == nil) {
-			u0 **next_field = node_next(map, snode);
-			u0 *next = *next_field;
-			*next_field = nil;
-			push(&snodes, snode, NODE_SIZE);
-			snode = next;
-			if (first) { first = false; continue; }
-			FREE(snode);  // we have a copy.
-		}
+u0 (associate)(u0 *self, const u0 *key, const u0 *value)
+{
+	GenericMap *map = self;
+	if (map->engine == MAP_TABLE) {
+		table_associate(self, key, value);
+		return UNIT;
 	}
-	// copied `snodes` (base/bucket nodes), now blank out the buckets array,
-	// and rewrite it with new and correct indices.
-	resize(&map->buckets,
-	       CEIL(usize, HASHMAP_GROWTH_FACTOR
-	         * (LOAD_FACTOR / HASHMAP_LOAD_THRESHOLD)
-	         * map->buckets.cap),
-		   NODE_SIZE);
-	null(&map->buckets, NODE_SIZE);
-	// repopulate.
-	umin *bucket = (u0 *)PTR(map->buckets);
-	for (usize i = 0; i < snodes.len; ++i) {
-		u0 *snode = get(&snodes, i, NODE_SIZE);
-		u64 shash = node_hash(map, snode);
-		usize sindex = bucket_index(map, shash);
-		u0 *bnode = bucket + sindex * NODE_SIZE;
-		// copy directly into bucket array.
-		if (node_hash(map, bnode) == 0) {
-			memcpy(bnode, snode, NODE_SIZE);
-			continue;
-		}
-		// otherwise, append to chain.
-		until (*(u0 **)node_next(map, bnode) == nil)
-			bnode = *(u0 **)node_next(map, bnode);
-		assert(bnode != nil);
-		// put `snode` on heap, and link up pointer to it.
-		u0 *new_snode = emalloc(1, NODE_SIZE);
-		memcpy(new_snode, snode, NODE_SIZE);
-		u0 **next_field = node_next(map, bnode);
-		*next_field = new_snode;
-	}
-	FREE_INSIDE(snodes);
-
+	move_buckets(map, HASHMAP_REHASH_STEP);
+	associate_hashed(map, key_hash(map, key), key, value);
 	return UNIT;
 }
 
-u0 *lookup(u0 *self, const u0 *key)
+/// Look up a key (with the given hash), in a chained map.
+static u0 *lookup_hashed(GenericMap *map, u64 hash, const u0 *key)
 {
-	GenericMap *map = self;
-	u64 hash = map->hasher(key, map->key_size);
-	usize index = bucket_index(map, hash);
+	if (map->buckets.cap == 0) return nil;
+	u0 *head;
+	home_bucket(map, hash, &head);
 
-	u0 *head = (umin *)PTR(map->buckets) + index * map->node_size;
 	// search hashnode-chain.
 	until (head == nil || node_hash(map, head) == 0) {
-		if (key_eq(map, node_key(map, head), key))
+		if (map_keys_equal(map, node_key(map, head), key))
 			return node_value(map, head);
 		head = *(u0 **)node_next(map, head);
 	}
@@ -608,18 +992,109 @@ u0 *lookup(u0 *self, const u0 *key)
 	return nil;
 }
 
+u0 *lookup(u0 *self, const u0 *key)
+{
+	GenericMap *map = self;
+	if (map->engine == MAP_TABLE)
+		return table_lookup(self, key);
+	move_buckets(map, HASHMAP_REHASH_STEP);
+	return lookup_hashed(map, key_hash(map, key), key);
+}
+
+/// Hash of each of a batch of keys, with the start of where each
+/// is looked for fetched into the cache ahead of time.
+static u0 hash_batch(GenericMap *map, const umin *keys, usize count, u64 *hashes)
+{
+	for (usize i = 0; i < count; ++i) {
+		const umin *key = keys + i * map->key_size;
+		if (map->engine == MAP_TABLE) {
+			hashes[i] = map->hasher(key, map->key_size);
+			table_prefetch(map, hashes[i]);
+		} else {
+			u0 *head;
+			hashes[i] = key_hash(map, key);
+			if (map->buckets.cap == 0) continue;
+			home_bucket(map, hashes[i], &head);
+			__builtin_prefetch(head);
+		}
+	}
+}
+
+u0 reserve_map(u0 *self, usize count)
+{
+	GenericMap *map = self;
+	if (map->engine == MAP_TABLE) {
+		table_reserve(self, count);
+		return UNIT;
+	}
+	usize cap = CEIL(usize, (map->len + count) / HASHMAP_LOAD_THRESHOLD) + 1;
+	if (cap > map->buckets.cap)
+		resize_buckets(map, cap);
+	return UNIT;
+}
+
+u0 (associate_many)(u0 *self, usize count, const u0 *keys, const u0 *values)
+{
+	GenericMap *map = self;
+	reserve_map(map, count);
+	u64 hashes[MAP_BATCH];
+	const umin *key = keys, *value = values;
+	for (usize done = 0; done < count; done += MAP_BATCH) {
+		usize batch = min(count - done, (usize)MAP_BATCH);
+		hash_batch(map, key, batch, hashes);
+		for (usize i = 0; i < batch; ++i) {
+			if (map->engine == MAP_TABLE) {
+				table_associate_hashed(map, hashes[i], key, value);
+			} else {
+				move_buckets(map, HASHMAP_REHASH_STEP);
+				associate_hashed(map, hashes[i], key, value);
+			}
+			key += map->key_size;
+			value += map->value_size;
+		}
+	}
+	return UNIT;
+}
+
+usize lookup_many(u0 *self, usize count, const u0 *keys, u0 **found)
+{
+	GenericMap *map = self;
+	u64 hashes[MAP_BATCH];
+	usize hits = 0;
+	const umin *key = keys;
+	// buckets are moved before, not during, so every value found stays put.
+	unless (map->engine == MAP_TABLE)
+		move_buckets(map, HASHMAP_REHASH_STEP);
+	for (usize done = 0; done < count; done += MAP_BATCH) {
+		usize batch = min(count - done, (usize)MAP_BATCH);
+		hash_batch(map, key, batch, hashes);
+		for (usize i = 0; i < batch; ++i, key += map->key_size) {
+			u0 *value = map->engine == MAP_TABLE
+				? table_lookup_hashed(map, hashes[i], key)
+				: lookup_hashed(map, hashes[i], key);
+			found[done + i] = value;
+			hits += value != nil;
+		}
+	}
+	return hits;
+}
+
 bool drop(u0 *self, const u0 *key)
 {
 	GenericMap *map = self;
-	u64 hash = map->hasher(key, map->key_size);
-	usize index = bucket_index(map, hash);
+	if (map->engine == MAP_TABLE)
+		return table_drop(self, key);
+	if (map->buckets.cap == 0) return false;
+	move_buckets(map, HASHMAP_REHASH_STEP);
+	u64 hash = key_hash(map, key);
+	u0 *head;
+	MemArray *buckets = home_bucket(map, hash, &head);
 
-	u0 *head = (umin *)PTR(map->buckets) + index * map->node_size;
 	u0 *node = head;
 	u0 *last = nil;
 	// search hasnode-chain.
 	until (node == nil || node_hash(map, node) == 0) {
-		if (key_eq(map, node_key(map, node), key))
+		if (map_keys_equal(map, node_key(map, node), key))
 			break;
 		last = node;
 		node = *(u0 **)node_next(map, node);
@@ -635,12 +1110,13 @@ bool drop(u0 *self, const u0 *key)
 		u0 *next = *(u0 **)node_next(map, node);
 		if (next == nil) {
 			zero(node, map->node_size);
-			--map->buckets.len;
+			--buckets->len;
 		} else {
 			// otherwise, we need to copy the node into the bucket array,
 			// overwriting the node that we are deleting.
 			memcpy(node, next, map->node_size);
-			FREE(next);  //< it is now in the base of the bucket array.
+			//< it is now in the base of the bucket array.
+			pool_give(&map->pool, next);
 		}
 	} else {
 		// otherwise, re-order the pointers and free the node.
@@ -648,13 +1124,43 @@ bool drop(u0 *self, const u0 *key)
 		u0 **last_next_field = node_next(map, last);
 		u0 **node_next_field = node_next(map, node);
 		*last_next_field = *node_next_field;
-		FREE(node);
+		pool_give(&map->pool, node);
 	}
 
 	--map->len;
 	return true;
 }
 
+u0 *map_next(u0 *self, MapCursor *cursor)
+{
+	GenericMap *map = self;
+	if (map->engine == MAP_TABLE)
+		return table_next_entry(self, cursor);
+	// carry on down the chain.
+	if (cursor->node != nil) {
+		cursor->node = *(u0 **)node_next(map, cursor->node);
+		if (cursor->node != nil) return cursor->node;
+	}
+	// otherwise, on to the next populated bucket: of `buckets`,
+	// then of the `old_buckets` which are yet to be moved.
+	for (;;) {
+		const MemArray *buckets = cursor->old
+			? &map->old_buckets
+			: (MemArray *)&map->buckets;
+		// none have been moved into new buckets which are still being zeroed.
+		usize cap = cursor->old || !is_resizing(map) || map->cleared == buckets->cap
+			? buckets->cap : 0;
+		while (cursor->index < cap) {
+			u0 *node = PTR(*buckets) + cursor->index++ * map->node_size;
+			if (node_hash(map, node) != 0)
+				return cursor->node = node;
+		}
+		if (cursor->old || !is_resizing(map)) return nil;
+		cursor->old = true;
+		cursor->index = map->moved;
+	}
+}
+
 GenericSlice get_keys(u0 *self)
 {
 	GenericMap *map = self;
@@ -664,38 +1170,24 @@ GenericSlice get_keys(u0 *self)
 	};
 
 	usize j = 0;
-	for (usize i = 0; i < map->buckets.cap; ++i) {
-		u0 *node = (umin *)PTR(map->buckets) + i * map->node_size;
-		if (node_hash(map, node) == 0) continue;
-
-		until (node == nil) {
-			set(&ks, j++, node_key(map, node), map->key_size);
-			node = *(u0 **)node_next(map, node);
-		}
-	}
+	MapCursor cursor = { 0 };
+	for (u0 *entry; (entry = map_next(map, &cursor)) != nil; ++j)
+		set(&ks, j, (umin *)entry + map->key_offset, map->key_size);
 	assert(j == map->len);
 	return ks;
 }
 
 bool has_key(u0 *self, u0 *key)
-{
-	GenericMap *map = self;
-	for (usize i = 0; i < map->buckets.cap; ++i) {
-		u0 *node = (umin *)PTR(map->buckets) + i * map->node_size;
-		if (node_hash(map, node) == 0) continue;
-
-		until (node == nil) {
-			if (key_eq(map, node_key(map, node), key))
-				return true;
-			node = *(u0 **)node_next(map, node);
-		}
-	}
-	return false;
-}
+{ return lookup(self, key) != nil; }
 
 u0 empty_map(u0 *self)
 {
 	GenericMap *map = self;
+	if (map->engine == MAP_TABLE) {
+		table_empty(self);
+		return UNIT;
+	}
+	move_buckets(map, SIZE_MAX);
 	for (usize i = 0; i < map->buckets.cap; ++i) {
 		u0 *node = (umin *)PTR(map->buckets) + i * map->node_size;
 		if (node_hash(map, node) == 0) continue;
@@ -703,7 +1195,7 @@ u0 empty_map(u0 *self)
 		node = *(u0 **)node_next(map, node);
 		until (node == nil) {
 			u0 *next = *(u0 **)node_next(map, node);
-			FREE(node);
+			pool_give(&map->pool, node);
 			node = next;
 		}
 	}
@@ -714,6 +1206,9 @@ u0 empty_map(u0 *self)
 bool is_empty_map(u0 *self)
 {
 	GenericMap *map = self;
+	if (map->engine == MAP_TABLE)
+		return map->len == 0;
+	move_buckets(map, SIZE_MAX);
 	if (PTR(map->buckets) == nil) return true;
 
 	for (usize i = 0; i < map->buckets.cap; ++i) {
@@ -727,8 +1222,14 @@ bool is_empty_map(u0 *self)
 u0 free_map(u0 *self)
 {
 	GenericMap *map = self;
+	if (map->engine == MAP_TABLE) {
+		table_free(self);
+		return UNIT;
+	}
 	empty_map(map);
-	FREE_INSIDE(map->buckets);
+	pool_release(&map->pool, map->buckets.alloc);
+	deallocate(map->buckets.alloc, PTR(map->buckets),
+	           map->buckets.cap * map->node_size);
 	map->buckets.value = nil;
 	return UNIT;
 }
@@ -736,6 +1237,11 @@ u0 free_map(u0 *self)
 u0 dump_hashmap(u0 *self, byte *key_fmt, byte *value_fmt)
 {
 	GenericMap *map = self;
+	if (map->engine == MAP_TABLE) {
+		table_dump(self, key_fmt, value_fmt);
+		return UNIT;
+	}
+	move_buckets(map, SIZE_MAX);
 	const usize NODE_SIZE = map->node_size;
 	umin *buckets = (u0 *)PTR(map->buckets);
 	eprintln("entries:     %zu", map->len);
@@ -25,6 +25,11 @@
 #endif
 
 /* Default macros */
+#ifdef CRELUDE_PROFILE  // See `profile.h`.
+	#define MALLOC(BYTES) profile_malloc(PROFILE_SITE("MALLOC"), (BYTES))
+	#define REALLOC(PTR, BYTES) profile_realloc(PROFILE_SITE("REALLOC"), (PTR), (BYTES))
+	#define FREE(PTR) profile_free((PTR))
+#endif
 #ifndef FREE
 	#define FREE free
 #endif
@@ -82,6 +87,9 @@
 	"." TSTR(crelude_V_PATCH)
 
 #define ARRAY_REALLOC_FACTOR 1.5
+/// Rotations which move at most this many bytes out of the
+/// way go through a buffer on the stack (see `memrotate`).
+#define ROTATE_BUFFER_SIZE 1024
 
 /* Syntax helpers */
 #define loop while (1)
@@ -100,8 +108,21 @@
 	T (*value); \
 	usize len;  \
 	usize cap;  \
+	Allocator *alloc; /* nil means the default allocator. */ \
+	const GrowthPolicy *growth; /* nil means the default policy. */ \
 }
 #define newarray(NT, T) typedef arrayof(T) NT
+/* An array whose first N elements live inline, after the array fields
+ * (so it may be used wherever an array is), see `SMALL_ARRAY`. */
+#define smallarrayof(T, N) struct { \
+	T (*value); \
+	usize len;  \
+	usize cap;  \
+	Allocator *alloc; /* &SMALL_BUFFER, until spilled to the heap. */ \
+	const GrowthPolicy *growth; \
+	T buffer[N]; \
+}
+#define newsmallarray(NT, T, N) typedef smallarrayof(T, N) NT
 #define sliceof(T) struct { \
 	T (*value); \
 	usize len;  \
@@ -122,29 +143,109 @@ enum HashKeyType {  // Use this to pick a default hash method/function.
 }; unqualify(enum, HashKeyType);
 #define HASHMAP_LOAD_THRESHOLD 0.85
 #define HASHMAP_GROWTH_FACTOR  2
-#define newmap(NT, K, V) typedef mapof(K, V) NT
-#define mapof(K, V) struct { \
+/// Buckets moved by each `associate`, `lookup` or `drop` on a map
+/// which is being resized incrementally.
+#define HASHMAP_REHASH_STEP 8
+/// Keys hashed (and prefetched) at a time by `associate_many`
+/// and `lookup_many`, before any are compared.
+#define MAP_BATCH 16
+/// How a map is laid out, so the generic map functions (and `ASSOCIATE`,
+/// `LOOKUP`, etc.) may tell which they were given.
+enum MapEngine {
+	MAP_CHAINED = 0,  //< `mapof`: buckets, each heading a chain of nodes.
+	MAP_TABLE         //< `tableof`: open addressing, see table.h.
+}; unqualify(enum, MapEngine);
+/* Fields which every kind of map starts with, in this order. */
+#define MAP_HEADER_(NODE) \
 	usize len; \
-	arrayof(hashnode(K, V)) buckets; /* a hash value of zero indicates absence. */\
+	arrayof(NODE) buckets; \
 	usize value_size; \
 	usize   key_size; \
 	usize  node_size; \
-	/* offsets of `hashnode` struct. */ \
+	/* offsets of the node struct. */ \
 	usize  hash_offset; \
 	usize   key_offset; \
 	usize value_offset; \
 	usize  next_offset; \
 	HashKeyType key_type; /* < how should the hash-function hash the key. */ \
 	u64 (*hasher)(const u0 *, usize); \
+	MapEngine engine;
+#define newmap(NT, K, V) typedef mapof(K, V) NT
+#define mapof(K, V) struct { \
+	/* a hash value of zero (in a bucket) indicates absence. */ \
+	MAP_HEADER_(hashnode(K, V)) \
+	NodePool pool; /* < recycles chain nodes. */ \
+	/* when set, growing moves a few buckets per operation, */ \
+	/* with the `old_buckets` still in use until all are moved. */ \
+	bool incremental; \
+	MemArray old_buckets; \
+	usize moved; /* < number of `old_buckets` already moved. */ \
+	usize cleared; /* < number of the new `buckets` zeroed, before any are moved. */ \
 }
 #define hashnode(K, V) struct { \
 	hashof(K) key; \
 	V value;  /* < value stored.   */ \
 	u0 *next; /* < next hash-node. */ \
 }
-#define MMAKE(K, V, CAP) { \
+/// How keys of type `K` are hashed and compared, by default.
+#define MAP_KEY_TYPE(K) _Generic(*(K *)NULL, \
+	string: HKT_STRING, \
+	runic: HKT_RUNIC, \
+	byte *: HKT_CSTRING, \
+	MemSlice: HKT_MEM_SLICE, \
+	char[8]: HKT_SMALL_INTEGER, \
+	char[7]: HKT_SMALL_INTEGER, \
+	char[6]: HKT_SMALL_INTEGER, \
+	char[5]: HKT_SMALL_INTEGER, \
+	char[4]: HKT_SMALL_INTEGER, \
+	char[3]: HKT_SMALL_INTEGER, \
+	char[2]: HKT_SMALL_INTEGER, \
+	char[1]: HKT_SMALL_INTEGER, \
+	signed char:        HKT_SMALL_INTEGER, \
+	signed short:       HKT_SMALL_INTEGER, \
+	signed int:         HKT_SMALL_INTEGER, \
+	signed long:        HKT_SMALL_INTEGER, \
+	signed long long:   HKT_SMALL_INTEGER, \
+	unsigned char:      HKT_SMALL_INTEGER, \
+	unsigned short:     HKT_SMALL_INTEGER, \
+	unsigned int:       HKT_SMALL_INTEGER, \
+	unsigned long:      HKT_SMALL_INTEGER, \
+	unsigned long long: HKT_SMALL_INTEGER, \
+	float:  HKT_SMALL_INTEGER, \
+	double: HKT_SMALL_INTEGER, \
+	default: HKT_RAW_BYTES)
+/// The default hash function for keys of type `K`.
+#define MAP_HASHER(K) _Generic(*(K *)NULL, \
+	string: string_hash, \
+	runic: runic_hash, \
+	byte *: cstring_hash, \
+	MemSlice: mem_hash, \
+	char[8]: integer_hash, \
+	char[7]: integer_hash, \
+	char[6]: integer_hash, \
+	char[5]: integer_hash, \
+	char[4]: integer_hash, \
+	char[3]: integer_hash, \
+	char[2]: integer_hash, \
+	char[1]: integer_hash, \
+	signed char:        integer_hash, \
+	signed short:       integer_hash, \
+	signed int:         integer_hash, \
+	signed long:        integer_hash, \
+	signed long long:   integer_hash, \
+	unsigned char:      integer_hash, \
+	unsigned short:     integer_hash, \
+	unsigned int:       integer_hash, \
+	unsigned long:      integer_hash, \
+	unsigned long long: integer_hash, \
+	float:  integer_hash, \
+	double: integer_hash, \
+	default: default_hash)
+#define MMAKE(K, V, CAP) MMAKE_WITH(K, V, CAP, nil)
+/// Like `MMAKE`, but buckets and chain nodes are allocated with `ALLOC`.
+#define MMAKE_WITH(K, V, CAP, ALLOC) { \
 	.len = 0, \
-	.buckets = AMAKE(hashnode(K, V), CAP), \
+	.buckets = AMAKE_WITH(hashnode(K, V), CAP, ALLOC), \
 	.key_size = sizeof(K), \
 	.value_size = sizeof(V), \
 	.node_size = sizeof(hashnode(K, V)), \
@@ -152,64 +253,20 @@ enum HashKeyType {  // Use this to pick a default hash method/function.
 	.key_offset   = offsetof(hashnode(K, V), key) + offsetof(hashof(K), value), \
 	.value_offset = offsetof(hashnode(K, V), value), \
 	.next_offset  = offsetof(hashnode(K, V), next), \
-	.key_type = _Generic(*(K *)NULL, \
-		string: HKT_STRING, \
-		runic: HKT_RUNIC, \
-		byte *: HKT_CSTRING, \
-		MemSlice: HKT_MEM_SLICE, \
-		char[8]: HKT_SMALL_INTEGER, \
-		char[7]: HKT_SMALL_INTEGER, \
-		char[6]: HKT_SMALL_INTEGER, \
-		char[5]: HKT_SMALL_INTEGER, \
-		char[4]: HKT_SMALL_INTEGER, \
-		char[3]: HKT_SMALL_INTEGER, \
-		char[2]: HKT_SMALL_INTEGER, \
-		char[1]: HKT_SMALL_INTEGER, \
-		signed char:        HKT_SMALL_INTEGER, \
-		signed short:       HKT_SMALL_INTEGER, \
-		signed int:         HKT_SMALL_INTEGER, \
-		signed long:        HKT_SMALL_INTEGER, \
-		signed long long:   HKT_SMALL_INTEGER, \
-		unsigned char:      HKT_SMALL_INTEGER, \
-		unsigned short:     HKT_SMALL_INTEGER, \
-		unsigned int:       HKT_SMALL_INTEGER, \
-		unsigned long:      HKT_SMALL_INTEGER, \
-		unsigned long long: HKT_SMALL_INTEGER, \
-		float:  HKT_SMALL_INTEGER, \
-		double: HKT_SMALL_INTEGER, \
-		default: HKT_RAW_BYTES), \
-	.hasher = _Generic(*(K *)NULL, \
-		string: string_hash, \
-		runic: runic_hash, \
-		byte *: cstring_hash, \
-		MemSlice: mem_hash, \
-		char[8]: upcast_hash, \
-		char[7]: upcast_hash, \
-		char[6]: upcast_hash, \
-		char[5]: upcast_hash, \
-		char[4]: upcast_hash, \
-		char[3]: upcast_hash, \
-		char[2]: upcast_hash, \
-		char[1]: upcast_hash, \
-		signed char:        upcast_hash, \
-		signed short:       upcast_hash, \
-		signed int:         upcast_hash, \
-		signed long:        upcast_hash, \
-		signed long long:   upcast_hash, \
-		unsigned char:      upcast_hash, \
-		unsigned short:     upcast_hash, \
-		unsigned int:       upcast_hash, \
-		unsigned long:      upcast_hash, \
-		unsigned long long: upcast_hash, \
-		float:  upcast_hash, \
-		double: upcast_hash, \
-		default: default_hash) \
+	.key_type = MAP_KEY_TYPE(K), \
+	.hasher = MAP_HASHER(K), \
+	.engine = MAP_CHAINED \
 }
 /// Create new map / initialise map from map variable.
 #define MNEW(VARIABLE, CAP) (typeof(VARIABLE))MMAKE( \
 	typeof((VARIABLE).buckets.value[0].key.value), \
 	typeof((VARIABLE).buckets.value[0].value), \
 	CAP)
+/// Like `MNEW`, but with a given allocator.
+#define MNEW_WITH(VARIABLE, CAP, ALLOC) (typeof(VARIABLE))MMAKE_WITH( \
+	typeof((VARIABLE).buckets.value[0].key.value), \
+	typeof((VARIABLE).buckets.value[0].value), \
+	CAP, ALLOC)
 
 #define NTH(LIST, N) UNWRAP((LIST))[(N)]
 #define GET(LIST, N) __extension__\
@@ -360,6 +417,60 @@ typedef u32 rune;
 	typedef long double f128;
 #endif
 
+/// Interface to a memory allocator.  Arrays (and thus maps) carry
+/// a pointer to one, and a `nil` pointer stands for `GLOBAL_ALLOCATOR`,
+/// which just calls the `MALLOC`, `REALLOC` and `FREE` macros.
+/// The sizes of blocks are always passed back in, so allocators
+/// need not keep any book of their own.
+record(Allocator) {
+	u0 *(*alloc)(u0 *context, usize bytes);
+	u0 *(*realloc)(u0 *context, u0 *ptr, usize old_bytes, usize new_bytes);
+	u0  (*free)(u0 *context, u0 *ptr, usize bytes);
+	u0 *context;  ///< Allocator state (e.g. an arena), given to every call.
+	bool zeroed;  ///< Fresh and grown memory is known to be zeroed already.
+};
+
+/// How an array picks its new capacity, when it has run out.
+/// Arrays carry a pointer to one, and `nil` stands for the default,
+/// growing by `ARRAY_REALLOC_FACTOR` (plus what was asked for).
+/// e.g.
+/// ```c
+/// static const GrowthPolicy by_batch = FIXED_GROWTH(4096);
+/// xs.growth = &by_batch;      //< or,
+/// ys.growth = &GROWTH_POW2;
+/// ```
+record(GrowthPolicy) {
+	/// New capacity, of at least `needed` elements, each `width` bytes.
+	usize (*capacity)(const GrowthPolicy *policy,
+	                  usize cap, usize needed, usize width);
+	f64 factor;  ///< Multiplier, for geometric growth.
+	usize step;  ///< Number of elements, for fixed-step growth.
+};
+
+/// Pool of equally sized nodes (e.g. hash-map chain nodes).
+/// Nodes are carved out of slabs, and given back to a free-list,
+/// so they may be recycled without going through the allocator.
+record(NodePool) {
+	u0 *free;   ///< Free-list, linked through the first word of each node.
+	u0 *slabs;  ///< List of slabs, each headed by a `PoolSlab`.
+	usize slab_nodes;  ///< Number of nodes in the next slab.
+};
+/// Header of a slab in a `NodePool`.
+record(PoolSlab) {
+	PoolSlab *next;
+	usize bytes;  ///< Size of the whole slab, including this header.
+};
+#define POOL_SLAB_MIN_NODES 8
+#define POOL_SLAB_MAX_NODES 1024
+
+/// Where an iteration over a map's entries has got to, see `map_next`.
+/// Starts zeroed, e.g. `MapCursor cursor = { 0 };`.
+record(MapCursor) {
+	usize index;  ///< Next bucket (or slot) to look in.
+	u0 *node;     ///< Entry last given, in a chained map.
+	bool old;     ///< Looking in the `old_buckets`, part way through a resize.
+};
+
 /// Array with pointer to void.
 newarray(GenericArray, u0);
 /// Array with pointer type to smallest addressable units of memory.
@@ -395,12 +506,28 @@ extern u0 panic(const byte *, ...) __attribute__((noreturn));
 extern u0 *or(const u0 *nullable, const u0 *nonnull);
 extern bool is_zero(imax);
 extern bool is_zerof(f64);
+/// Whether every byte in a block of memory is zero.
 extern bool is_zeroed(u0 *, usize);
 /// Zero a block of memory.
 /// @param[out] blk Pointer to start of block.
 /// @param[in] width How many bytes to zero.
 /// e.g., for an array `width = lenght * sizeof(elem)`.
 extern u0 zero(u0 *blk, usize width);
+/// The default allocator, wrapping `MALLOC`, `REALLOC` and `FREE`.
+extern Allocator GLOBAL_ALLOCATOR;
+/// Stands for the inline buffer of a small array (see `SMALL_ARRAY`).
+/// Freeing with it does nothing, and reallocating copies the buffer
+/// out into the default allocator, which the array then carries on with.
+extern Allocator SMALL_BUFFER;
+/// Allocate `bytes` with an allocator (`nil` for the default one).
+extern u0 *allocate(Allocator *, usize bytes);
+/// Reallocate a block previously allocated by the same allocator.
+/// Allocates if `ptr` is `nil`, and frees if `new_bytes` is zero.
+extern u0 *reallocate(Allocator *, u0 *ptr, usize old_bytes, usize new_bytes);
+/// Free a block of `bytes` previously allocated by the same allocator.
+extern u0 deallocate(Allocator *, u0 *ptr, usize bytes);
+/// Like `emalloc`, but with a given allocator.
+extern u0 *eallocate(Allocator *, usize, usize);
 /// Malloc with zeros, and panics when out of memory.
 extern u0 *emalloc(usize, usize);
 /// Reverse an array or slice in-place.
@@ -414,6 +541,7 @@ extern MemSlice reverse_endianness(MemSlice bytes);
 /// @returns true if little endian, false if big endian.
 bool is_little_endian(void);
 /// Read big-endian integer.
+/// @see byteorder.h, for converting whole arrays of numbers.
 u128 big_endian(umin *start, usize bytes);
 /// Given a slice, swap the two blocks within the slice
 /// formed by selecting a pivot point (in-place).
@@ -430,7 +558,14 @@ extern u0 swap(u0 *self, usize pivot, usize width);
 /// @param[in,out] a Block of memory `a`, to be swapped for `b`.
 /// @param[in,out] b Block of memory `b`, to be swapped for `a`.
 /// @param[in] bytes The common size of block `a` and `b` in bytes.
+/// @note The blocks must not overlap.
 extern u0 memswap(umin *a, umin *b, usize bytes);
+/// Rotates a block of memory, such that the byte at `pivot` comes first.
+/// Used by `swap`, `shift` and `cut`, and so by `SHIFT`, `CUT` and `REMOVE`.
+/// @param[in,out] blk Start of the block.
+/// @param[in] bytes The size of the whole block, in bytes.
+/// @param[in] pivot Where the block is split into the two to be swapped.
+extern u0 memrotate(umin *blk, usize bytes, usize pivot);
 /// Resizes the array, i.e. changes the capacity to a given value.
 /// Akin to `realloc`.
 /// @returns How much of the array is empty (i.e. `cap - len`).
@@ -442,6 +577,33 @@ extern usize resize(u0 *self, usize cap, usize width);
 /// @param[in] width Size of the individual elements in the array, in bytes.
 /// @returns How much capacity increased.
 extern usize grow(u0 *self, usize count, usize width);
+/// Multiplies the capacity by `policy->factor`.
+extern usize growth_geometric(const GrowthPolicy *, usize cap, usize needed, usize width);
+/// Rounds the capacity up to a power of two.
+extern usize growth_pow2(const GrowthPolicy *, usize cap, usize needed, usize width);
+/// Grows geometrically, then rounds up to a whole number of memory pages.
+extern usize growth_pages(const GrowthPolicy *, usize cap, usize needed, usize width);
+/// Rounds the capacity up to a multiple of `policy->step` elements.
+extern usize growth_fixed(const GrowthPolicy *, usize cap, usize needed, usize width);
+/// Geometric growth by a factor of two.
+extern const GrowthPolicy GROWTH_DOUBLING;
+/// Power-of-two capacities.
+extern const GrowthPolicy GROWTH_POW2;
+/// Page-rounded (by `ARRAY_REALLOC_FACTOR`) geometric growth.
+extern const GrowthPolicy GROWTH_PAGES;
+#define GEOMETRIC_GROWTH(FACTOR) \
+	((GrowthPolicy){ .capacity = growth_geometric, .factor = (FACTOR) })
+#define FIXED_GROWTH(STEP) \
+	((GrowthPolicy){ .capacity = growth_fixed, .step = (STEP) })
+/// Makes sure there is room for (at least) `count` more elements,
+/// without changing the length.  Allocates exactly, if it must.
+/// @returns How much capacity increased.
+extern usize reserve(u0 *self, usize count, usize width);
+/// Gives back unused capacity, such that `cap == len`.
+/// @returns How much capacity decreased.
+extern usize shrink_to_fit(u0 *self, usize width);
+/// Empties an array, but keeps its memory for reuse.
+extern u0 clear(u0 *self);
 /// Get pointer to element at index in slice/array.
 /// @param[in] self Pointer to slice or array.
 /// @param[in] index Index of element you wish to retrieve.
@@ -511,9 +673,14 @@ extern i16 string_ncmp(const string, const string, usize n);
 extern u64 hash_string(const string);
 /// Hash a byte slice.
 extern u64 hash_bytes(const MemSlice);
+/// Hash a byte slice, starting from `seed` (e.g. a random one, so the
+/// hashes of keys are not known ahead of time).
+extern u64 hash_bytes_seeded(const MemSlice, u64 seed);
 /// Map / associate a key with a value, i.e. insert into the hash-map/table.
 extern u0 associate(u0 *self, const u0 *key, const u0 *value);
 /// Look-up / get value from hash-map/table given the key.
+/// @note On an `incremental` map this may move buckets along,
+///       so it is not safe to call from many threads at once.
 extern u0 *lookup(u0 *self, const u0 *key);
 /// Drop / delete / remove key-value pair from the hash-table.
 /// This frees/deallocates the node, and the key and value are deleted.
@@ -523,8 +690,25 @@ extern bool drop(u0 *self, const u0 *key);
 /// Get slice of key pointers of all keys in map/hash-table.
 /// @note Returns a heap allocated slice, remember to free.
 extern GenericSlice get_keys(u0 *self);
-/// Checks if entry / key-value pair is present in hash-table/map given a key.
+/// Checks if entry / key-value pair is present in hash-table/map given a key
+/// (by hashing it, as `lookup`).
 extern bool has_key(u0 *self, u0 *key);
+/// Make room for `count` more entries, so adding them does not resize the map.
+extern u0 reserve_map(u0 *self, usize count);
+/// Associate each of `count` keys with the value at the same place,
+/// from arrays `keys` and `values`, making room for all of them first.
+/// Keys are hashed and their buckets fetched a batch at a time,
+/// so that waiting on memory overlaps.
+extern u0 associate_many(u0 *self, usize count, const u0 *keys, const u0 *values);
+/// Look up each of `count` keys, as `associate_many`, pointing `found[i]`
+/// to the value of the `i`th key (or `nil` where there is none).
+/// @returns the number of keys found.
+extern usize lookup_many(u0 *self, usize count, const u0 *keys, u0 **found);
+/// Next entry of the map after `cursor`, or `nil` once there are none.
+/// Entries are `hashnode`s of a `mapof`, or `tableslot`s of a `tableof`,
+/// given in no particular order, without allocating.
+/// @note The map must not be changed while iterating over it.
+extern u0 *map_next(u0 *self, MapCursor *cursor);
 /// Empties out / deallocates all key-value pairs from the map.
 /// Map may still be repopulated again after this.
 extern u0 empty_map(u0 *self);
@@ -533,15 +717,25 @@ extern bool is_empty_map(u0 *self);
 /// Frees the map.  Not only empties it, but deallocates bucket array
 /// such that the map may not be used again.
 extern u0 free_map(u0 *self);
+/// Take a node of `node_size` bytes from the pool (uninitialised).
+/// A new slab is allocated with `allocator` when the pool runs dry.
+extern u0 *pool_take(NodePool *, usize node_size, Allocator *allocator);
+/// Give a node back to the pool it was taken from.
+extern u0 pool_give(NodePool *, u0 *node);
+/// Give all slabs back to the allocator.  Invalidates all nodes.
+extern u0 pool_release(NodePool *, Allocator *allocator);
 /// Internal use 99% of the time.
 extern usize init_hashnode(u0 *, const u0 *, u64, const u0 *, const u0 *);
+/// Whether two keys of a map are equal, going by its `key_type`.
+extern bool map_keys_equal(const u0 *self, const u0 *key0, const u0 *key1);
 /// Hashmap debugging function.
 extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 
 /* Common Macros */
 
 /// Copy an array or slice.
-/// @note Allocates on the heap.
+/// @note Allocates on the heap, with the default allocator.
+///       Use `ACOPY` for arrays that carry an allocator.
 #define COPY(SELF) __extension__\
 	({ __auto_type _self = (SELF); \
 	   __auto_type _copy = _self; \
@@ -549,6 +743,15 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 	   memcpy(PTR(_copy), PTR(_self), sizeof(*PTR(_copy)) * _copy.len); \
 	   _copy; })
 
+/// Copy an array, with the same allocator as the original.
+#define ACOPY(SELF) __extension__\
+	({ __auto_type _self = (SELF); \
+	   __auto_type _copy = _self; \
+	   _copy.cap = _copy.len; \
+	   PTR(_copy) = eallocate(_self.alloc, _self.len, sizeof(*PTR(_self))); \
+	   memcpy(PTR(_copy), PTR(_self), sizeof(*PTR(_copy)) * _copy.len); \
+	   _copy; })
+
 /// Convert array/slice to slice of bytes.
 #define TO_BYTES(SELF) __extension__\
 	({ __auto_type _self = (SELF); \
@@ -586,6 +789,16 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 	   typeof(*_self->value) _elem =  (ELEM); \
 	   push(_self, &_elem, sizeof(_elem)); })
 
+#define RESERVE(SELF, COUNT) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   reserve(_self, (COUNT), sizeof(*_self->value)); })
+
+#define SHRINK_TO_FIT(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   shrink_to_fit(_self, sizeof(*_self->value)); })
+
+#define CLEAR(SELF) clear(&(SELF))
+
 #define POP(SELF) __extension__\
 	({ __auto_type _self = &(SELF); \
 	   (typeof(_self->value))pop(_self, sizeof(*_self->value)); })
@@ -639,6 +852,26 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 	   __auto_type _key = (KEY); \
 	   drop(_self, &_key); })
 
+/// Associate the keys of one slice with the values of another, e.g.
+/// ```c
+/// mapof(string, u32) ids = MMAKE(string, u32, 0);
+/// ASSOCIATE_MANY(ids, names, numbers);
+/// ```
+#define ASSOCIATE_MANY(SELF, KEYS, VALS) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   __auto_type _keys = (KEYS); \
+	   __auto_type _vals = (VALS); \
+	   assert(_keys.len == _vals.len); \
+	   associate_many(_self, _keys.len, _keys.value, _vals.value); })
+
+/// Look up every key of a slice, pointing `FOUND[i]` to the value
+/// of the `i`th key (or to `nil`), and giving the number found.
+#define LOOKUP_MANY(SELF, KEYS, FOUND) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   __auto_type _keys = (KEYS); \
+	   typeof(_self->buckets.value[0].value) **_found = (FOUND); \
+	   lookup_many(_self, _keys.len, _keys.value, (u0 **)_found); })
+
 #define KEYS(MAP) __extension__\
 	({ __auto_type _map = &(MAP); \
 	   static GenericSlice _keys; \
@@ -660,16 +893,91 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 #define FIRST(SELF) NTH(SELF, 0)
 #define LAST(SELF) GET(SELF, -1)
 
-/// Minimal helper/wrapper around in-place `qsort` for arrays/slices.
+/// Generates inline array operations specialised to one array type, e.g.
+/// ```c
+/// newarray(IntArray, int);
+/// DEFINE_ARRAY_OPS(IntArray, int)
+/// ...
+/// IntArray xs = AMAKE(int, 8);
+/// IntArray_push(&xs, 42);
+/// int *x = IntArray_get(&xs, 0);
+/// ```
+/// Unlike `push`, `get`, etc. (and so `PUSH`, `GET`), the element width
+/// is a constant, and everything but reallocation is inlined, so each
+/// call compiles to a few loads and stores.
+/// Defines `NT##_grow`, `_push`, `_pop`, `_get`, `_set`, `_insert`
+/// and `_extend`, with the same meaning as their generic counterparts.
+/// @param NT A named array type, with `newarray(NT, T)`.
+/// @param T The type of element.
+#define DEFINE_ARRAY_OPS(NT, T) \
+	__attribute__((unused)) \
+	static inline usize NT##_grow(NT *self, usize count) \
+	{ \
+		if (__builtin_expect(self->len + count <= self->cap, true)) { \
+			self->len += count; \
+			return 0; \
+		} \
+		return grow(self, count, sizeof(T)); \
+	} \
+	__attribute__((unused)) \
+	static inline usize NT##_push(NT *self, T elem) \
+	{ \
+		usize growth = NT##_grow(self, 1); \
+		self->value[self->len - 1] = elem; \
+		return growth; \
+	} \
+	__attribute__((unused)) \
+	static inline T *NT##_pop(NT *self) \
+	{ \
+		assert(self->len > 0); \
+		return &self->value[--self->len]; \
+	} \
+	__attribute__((unused)) \
+	static inline T *NT##_get(const NT *self, usize index) \
+	{ return index < self->len ? &self->value[index] : nil; } \
+	__attribute__((unused)) \
+	static inline T *NT##_set(NT *self, usize index, T elem) \
+	{ \
+		if (index >= self->len) return nil; \
+		self->value[index] = elem; \
+		return &self->value[index]; \
+	} \
+	__attribute__((unused)) \
+	static inline usize NT##_insert(NT *self, usize index, T elem) \
+	{ \
+		usize growth = NT##_grow(self, 1); \
+		T *gap = &self->value[index]; \
+		memmove(gap + 1, gap, sizeof(T) * (self->len - 1 - index)); \
+		*gap = elem; \
+		return growth; \
+	} \
+	__attribute__((unused)) \
+	static inline usize NT##_extend(NT *self, const T *elems, usize count) \
+	{ \
+		usize end = self->len; \
+		usize growth = NT##_grow(self, count); \
+		memcpy(&self->value[end], elems, sizeof(T) * count); \
+		return growth; \
+	}
+
+#include "sort.h"
+
+/// In-place sort of arrays/slices, with a `qsort`-style comparison
+/// function.  The sort is generated for the element type, and calls
+/// `CMPR` directly (so it may be inlined), see sort.h.
 #define QSORT(SELF, CMPR) __extension__\
 	({ __auto_type _self = (SELF); \
-	   qsort(PTR(_self), _self.len, sizeof(*_self.value), CMPR); \
+	   SORT_BODY(typeof(*_self.value), _self.value, _self.len, \
+	       SORT_BY_COMPARE, CMPR); \
 	   _self; })
 
-/// Wrapper around in-place `qsort` for arrays and slices.
+/// In-place sort of arrays and slices.
 /// Creates a nested function within a statement-expression
 /// that is defined by the function body passed in as __VA_ARGS__
 /// to the macro, which defines the comparison function for the sort.
+/// The nested function is only ever called directly, and never has
+/// its address taken, so it is inlined, and needs no trampoline
+/// (nor an executable stack).
 /// This makes use of two GNU extensions:
 ///   'nested functions', and 'statement expressions'.
 /// e.g.
@@ -681,18 +989,19 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 ///     SORT(arr, self, other, { return my_compare(self, other); });
 ///     SORT(arr, self, other, CMP((Struct *)self->x, (Struct *)other->x));
 #define SORT(SELF, SUBJ, OTHR, ...) __extension__\
-	({ int compar_fn_(const u0 *SUBJ, const u0 *OTHR) __VA_ARGS__ \
+	({ inline __attribute__((always_inline)) \
+	   int compar_fn_(const u0 *SUBJ, const u0 *OTHR) __VA_ARGS__ \
 	   __auto_type _self = (SELF); \
-	   qsort(PTR(_self), _self.len, sizeof(*_self.value), compar_fn_); \
+	   SORT_BODY(typeof(*_self.value), _self.value, _self.len, \
+	       SORT_BY_COMPARE, compar_fn_); \
 	   _self; })
 
 /// Function body for comparison of
-/// items which have '>', '=' and '<' defined, e.g.
+/// items which have '>' and '<' defined, e.g.
 ///     int comparef(float a, float b) CMP(a, b)
+/// Without branches, and unordered items (NaNs) compare as equal.
 #define CMP(A, B) \
-	{ if ((A) <  (B)) return -1; \
-	  if ((A) == (B)) return  0; \
-	  if ((A) >  (B)) return +1; }
+	{ return ((A) > (B)) - ((A) < (B)); }
 
 // --- ANSI colour codes. ---
 
@@ -739,6 +1048,12 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 #define PTR(ARR) (ARR).value
 /// Call to `free` of inside of slice/array/newtype, etc.
 #define FREE_INSIDE(S) FREE((S).value)
+/// Free the inside of an array with the allocator it carries.
+#define AFREE(ARR) __extension__\
+	({ __auto_type _arr = &(ARR); \
+	   deallocate(_arr->alloc, PTR(*_arr), _arr->cap * sizeof(*PTR(*_arr))); \
+	   PTR(*_arr) = nil; \
+	   _arr->len = _arr->cap = 0; })
 /// Initialise sizing wrapper with literal.
 #define INIT(TYPE, ...) { \
 	.len = sizeof((TYPE[])__VA_ARGS__)/sizeof(TYPE), \
@@ -778,14 +1093,64 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 	.cap = (CAP), \
 	.value = emalloc((CAP), sizeof(TYPE)) \
 }
+/// Allocates a variable sized array, which will keep using `ALLOC`.
+#define AMAKE_WITH(TYPE, CAP, ALLOC) { \
+	.len = 0, \
+	.cap = (CAP), \
+	.alloc = (ALLOC), \
+	.value = eallocate((ALLOC), (CAP), sizeof(TYPE)) \
+}
+/// Declares an array, `NAME`, holding its first `N` elements in place,
+/// which only goes to the heap once it outgrows them.  e.g.
+/// ```c
+/// SMALL_ARRAY(digits, byte, 32);
+/// PUSH(digits, '0');             //< no allocation.
+/// novel_sprintf_append(&digits, "%zu", n);
+/// AFREE(digits);                 //< no-op, unless it had spilled.
+/// ```
+/// Its `value` points into itself, so it must not be copied by value
+/// (take `AVIEW` of it for that), nor returned from its scope.
+#define SMALL_ARRAY(NAME, TYPE, N) smallarrayof(TYPE, N) NAME = { \
+	.len = 0, \
+	.cap = (N), \
+	.alloc = &SMALL_BUFFER, \
+	.value = NAME.buffer \
+}
+/// (Re)initialise a small array in place, e.g. one inside a struct.
+#define SMALL_INIT(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   *_self = (typeof(*_self)){ \
+	       .cap = sizeof(_self->buffer) / sizeof(*_self->buffer), \
+	       .alloc = &SMALL_BUFFER, \
+	       .value = _self->buffer }; \
+	   _self; })
+/// Plain array (by value) sharing the elements of a small array,
+/// e.g. to pass to `%D` in `novel_printf`.
+#define AVIEW(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   (arrayof(typeof(*_self->value))){ \
+	       .value = _self->value, .len = _self->len, .cap = _self->cap, \
+	       .alloc = _self->alloc, .growth = _self->growth }; })
+/// Whether a small array still uses its inline buffer.
+#define IS_INLINE(SELF) ((SELF).alloc == &SMALL_BUFFER)
+
 /// Create new array / initialise array from array variable.
 #define ANEW(VARIABLE, CAP) (typeof(VARIABLE))AMAKE(typeof((VARIABLE).value[0]), CAP)
+/// Like `ANEW`, but with a given allocator.
+#define ANEW_WITH(VARIABLE, CAP, ALLOC) \
+	(typeof(VARIABLE))AMAKE_WITH(typeof((VARIABLE).value[0]), CAP, ALLOC)
 
 /// Heap allocates a constant sized slice type.
 #define SMAKE(TYPE, LEN) { \
 	.len = (LEN), \
 	.value = emalloc((LEN), sizeof(TYPE)) \
 }
+/// Allocates a constant sized slice with `ALLOC`.
+/// Slices do not carry their allocator, free with `deallocate(ALLOC, ...)`.
+#define SMAKE_WITH(TYPE, LEN, ALLOC) { \
+	.len = (LEN), \
+	.value = eallocate((ALLOC), (LEN), sizeof(TYPE)) \
+}
 /// Create new slice / initialise slice from slice variable.
 #define SNEW(VARIABLE, LEN) (typeof(VARIABLE))SMAKE(typeof((VARIABLE).value[0]), LEN)
 
@@ -877,21 +1242,95 @@ extern u0 dump_hashmap(u0 *self, byte *key_formatter, byte *value_formatter);
 			      typeof((ELEMS).value) ptr, start; \
 				  usize index; \
 				  bool first, once; \
-				} it = { .item = *(ELEMS).value, \
+				} it = { .item = (ELEMS).len > 0 ? *(ELEMS).value \
+				                 : (typeof(*(ELEMS).value)){ 0 }, \
 				         .ptr = (ELEMS).value, \
 				         .start = (ELEMS).value, \
 				         .index = 0, \
 						 .first = true, \
 						 .once = true \
 				       }; it.once; it.once = false) \
-		for (typeof(*(ELEMS).value) ELEM = *(ELEMS).value; \
+		for (typeof(*(ELEMS).value) ELEM = it.item; \
 		    it.index < (ELEMS).len; \
-			++it.ptr, it.index = (it.ptr - it.start), \
-			  it.item = *it.ptr, it.first = false, ELEM = it.item)
+			++it.ptr, it.index = (it.ptr - it.start), it.first = false, \
+			  /* Never read past the last element. */ \
+			  it.index < (ELEMS).len ? (it.item = *it.ptr, ELEM = it.item, 0) : 0)
 
 #define foreach FOR_EACH
 
+/// Iterate over the entries of a map (or table), with `KEY` and `VALUE`
+/// copies of each entry's key and value, and `it.entry` pointing to it.
+/// Nothing is allocated.  e.g.
+/// ```c
+/// FOR_EACH_ENTRY(name, count, counts)
+///     println("%S: %zu", name, count);
+/// ```
+/// @note The map must not be changed while iterating over it.
+#define FOR_EACH_ENTRY(KEY, VALUE, MAP) \
+	for (struct { typeof(&(MAP)) map; \
+	              typeof(PTR((MAP).buckets)) entry; \
+	              MapCursor cursor; \
+	              bool once; \
+	            } it = { .map = &(MAP), .entry = nil, .cursor = { 0 }, .once = true }; \
+	     it.once; ) \
+		for (__attribute__((unused)) typeof(it.entry->value) VALUE \
+		       = (typeof(it.entry->value)){ 0 }; it.once; it.once = false) \
+			for (__attribute__((unused)) typeof(it.entry->key.value) KEY \
+			       = (it.entry = map_next(it.map, &it.cursor)) == nil \
+			       ? (typeof(it.entry->key.value)){ 0 } \
+			       : (VALUE = it.entry->value, it.entry->key.value); \
+			     it.entry != nil; \
+			     (it.entry = map_next(it.map, &it.cursor)) == nil ? 0 \
+			       : (KEY = it.entry->key.value, VALUE = it.entry->value, 0))
+/// Iterate over the keys of a map, as `FOR_EACH_ENTRY`.
+#define FOR_EACH_KEY(KEY, MAP) FOR_EACH_ENTRY(KEY, _value_of_##KEY, MAP)
+/// Iterate over the values of a map, as `FOR_EACH_ENTRY`.
+#define FOR_EACH_VALUE(VALUE, MAP) FOR_EACH_ENTRY(_key_of_##VALUE, VALUE, MAP)
+
 /* static functions */
+/* |- hash mixing */
+
+#define HASH_SECRET_0 0x2D358DCCAA6C78A5ull
+#define HASH_SECRET_1 0x8BB84B93962EACC9ull
+#define HASH_SECRET_2 0x4B33A62ED433D4A3ull
+#define HASH_SECRET_3 0x4D5A2DA51DE1AA47ull
+
+/// Full 128-bit product of `a` and `b`, in two halves.
+static inline u0 hash_multiply(u64 a, u64 b, u64 *low, u64 *high)
+{
+#ifdef __SIZEOF_INT128__
+	u128 product = (u128)a * b;
+	*low = (u64)product;
+	*high = (u64)(product >> 64);
+#else
+	u64 a_hi = a >> 32, a_lo = (u32)a, b_hi = b >> 32, b_lo = (u32)b;
+	u64 lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi;
+	u64 middle = (lo_lo >> 32) + (u32)hi_lo + lo_hi;
+	*low = (middle << 32) | (u32)lo_lo;
+	*high = a_hi * b_hi + (hi_lo >> 32) + (middle >> 32);
+#endif
+}
+
+/// Mix two words into one, folding their 128-bit product in half.
+static inline u64 hash_mix(u64 a, u64 b)
+{
+	u64 low, high;
+	hash_multiply(a, b, &low, &high);
+	return low ^ high;
+}
+
+/// Hash an integer (of at most 64 bits), so that every bit of it
+/// affects every bit of the hash, starting from `seed`.
+static inline u64 hash_integer_seeded(u64 x, u64 seed)
+{
+	u64 low, high;
+	hash_multiply(x ^ HASH_SECRET_0, seed ^ HASH_SECRET_1, &low, &high);
+	return hash_mix(low ^ HASH_SECRET_0, high ^ HASH_SECRET_1);
+}
+
+static inline u64 hash_integer(u64 x)
+{ return hash_integer_seeded(x, 0); }
+
 /* |- default hash functions */
 
  __attribute__((unused))
@@ -924,6 +1363,14 @@ static u64 upcast_hash(const u0 *key, usize size)
 	return hash;  // no hashing, just cast the key to a u64.
 }
 
+ __attribute__((unused))
+static u64 integer_hash(const u0 *key, usize size)
+{
+	u64 x = 0;
+	memcpy(&x, key, size);
+	return hash_integer(x);
+}
+
  __attribute__((unused))
 static u64 cstring_hash(const u0 *key, usize _)
 {
@@ -937,6 +1384,22 @@ static u64 default_hash(const u0 *key, usize size)
 	return hash_bytes(VIEW(MemSlice, (umin *)key, 0, size));
 }
 
+#ifdef CRELUDE_PROFILE
+	#include "profile.h"
+	#define allocate(...)   PROFILE_CALL(allocate, __VA_ARGS__)
+	#define reallocate(...) PROFILE_CALL(reallocate, __VA_ARGS__)
+	#define eallocate(...)  PROFILE_CALL(eallocate, __VA_ARGS__)
+	#define emalloc(...)    PROFILE_CALL(emalloc, __VA_ARGS__)
+	#define resize(...)     PROFILE_CALL(resize, __VA_ARGS__)
+	#define grow(...)       PROFILE_CALL(grow, __VA_ARGS__)
+	#define push(...)       PROFILE_CALL(push, __VA_ARGS__)
+	#define insert(...)     PROFILE_CALL(insert, __VA_ARGS__)
+	#define extend(...)     PROFILE_CALL(extend, __VA_ARGS__)
+	#define splice(...)     PROFILE_CALL(splice, __VA_ARGS__)
+	#define associate(...)  PROFILE_CALL_U0(associate, __VA_ARGS__)
+	#define associate_many(...) PROFILE_CALL_U0(associate_many, __VA_ARGS__)
+#endif
+
 /* Only define a `main` if ENTRY_FUNCTION is defined */
 #ifdef ENTRY_FUNCTION
 	newslice(Arguments, string);
@@ -953,7 +1416,7 @@ static u64 default_hash(const u0 *key, usize size)
 			from_cstring, SCOLLECT(CArguments, argc, argv));
 		res = (ENTRY_FUNCTION)(args);
 
-		free(UNWRAP(args));
+		FREE(UNWRAP(args));
 		return res;
 	}
 #endif
@@ -0,0 +1,112 @@
+#include "deque.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+/// Offset of the `index`th element, from the start of the buffer.
+static inline usize slot(const MemDeque *deque, usize index, usize width)
+{ return ((deque->head + index) & (deque->cap - 1)) * width; }
+
+usize (deque_reserve)(u0 *self, usize count, usize width)
+{
+	MemDeque *deque = self;
+	usize needed = deque->len + count;
+	if (needed <= deque->cap) return 0;
+
+	usize old_cap = deque->cap;
+	usize new_cap = deque_capacity(max(2 * old_cap, needed));
+
+	umin *new = reallocate(deque->alloc, deque->value,
+		old_cap * width, new_cap * width);
+	if (new == nil)
+		PANIC("Could not reallocate %zu bytes.", new_cap * width);
+	deque->value = new;
+	deque->cap = new_cap;
+
+	// Unwrap the ring, if it wrapped, by moving whichever part is
+	// shorter.  The new buffer is at least twice as large, so the
+	// part is always moved into free space, without overlapping.
+	if (deque->head + deque->len > old_cap) {
+		usize front = old_cap - deque->head;  //< elements up to the end.
+		usize back = deque->len - front;      //< elements wrapped around.
+		if (back <= front) {
+			memcpy(new + old_cap * width, new, back * width);
+		} else {
+			usize head = new_cap - front;
+			memcpy(new + head * width, new + deque->head * width, front * width);
+			deque->head = head;
+		}
+	}
+	return new_cap - old_cap;
+}
+
+u0 *(push_back)(u0 *self, const u0 *elem, usize width)
+{
+	MemDeque *deque = self;
+	deque_reserve(deque, 1, width);
+	umin *ptr = deque->value + slot(deque, deque->len++, width);
+	memcpy(ptr, elem, width);
+	return ptr;
+}
+
+u0 *(push_front)(u0 *self, const u0 *elem, usize width)
+{
+	MemDeque *deque = self;
+	deque_reserve(deque, 1, width);
+	deque->head = (deque->head - 1) & (deque->cap - 1);
+	++deque->len;
+	umin *ptr = deque->value + deque->head * width;
+	memcpy(ptr, elem, width);
+	return ptr;
+}
+
+u0 *pop_back(u0 *self, usize width)
+{
+	MemDeque *deque = self;
+	assert(deque->len > 0);
+	return deque->value + slot(deque, --deque->len, width);
+}
+
+u0 *pop_front(u0 *self, usize width)
+{
+	MemDeque *deque = self;
+	assert(deque->len > 0);
+	umin *ptr = deque->value + deque->head * width;
+	deque->head = (deque->head + 1) & (deque->cap - 1);
+	--deque->len;
+	return ptr;
+}
+
+u0 *deque_get(const u0 *self, usize index, usize width)
+{
+	const MemDeque *deque = self;
+	if (index >= deque->len) return nil;
+	return deque->value + slot(deque, index, width);
+}
+
+usize deque_views(const u0 *self, usize from, usize upto,
+                  MemSlice views[2], usize width)
+{
+	const MemDeque *deque = self;
+	upto = min(upto, deque->len);
+	views[0] = views[1] = SEMPTY(MemSlice);
+	if (from >= upto) return 0;
+
+	usize start = (deque->head + from) & (deque->cap - 1);
+	usize len = upto - from;
+	usize first = min(len, deque->cap - start);
+	views[0] = VIEW(MemSlice, deque->value + start * width, 0, first);
+	if (first == len) return 1;
+	views[1] = VIEW(MemSlice, deque->value, 0, len - first);
+	return 2;
+}
+
+u0 deque_free(u0 *self, usize width)
+{
+	MemDeque *deque = self;
+	deallocate(deque->alloc, deque->value, deque->cap * width);
+	deque->value = nil;
+	deque->len = deque->cap = deque->head = 0;
+}
+
+#endif
@@ -0,0 +1,128 @@
+//! @file deque.h
+//! Double-ended queues, as circular buffers.  Pushing and popping
+//! at either end is O(1), unlike `SHIFT` and `UNSHIFT` on arrays,
+//! which move every element.  The capacity is always a power of two,
+//! such that the ring wraps around with a mask.
+//! e.g.
+//! ```c
+//! newdeque(Jobs, Job);
+//! Jobs queue = DMAKE(Job, 64);
+//! PUSH_BACK(queue, job);
+//! Job *next = POP_FRONT(queue);
+//! DFREE(queue);
+//! ```
+
+#pragma once
+#include "common.h"
+
+#define dequeof(T) struct { \
+	T (*value); \
+	usize len;  \
+	usize cap;  /* zero, or a power of two. */ \
+	usize head; /* where the first element is, in `value`. */ \
+	Allocator *alloc; /* nil means the default allocator. */ \
+}
+#define newdeque(NT, T) typedef dequeof(T) NT
+
+/// Deque with pointer to void.
+newdeque(GenericDeque, u0);
+/// Deque with pointer type to smallest addressable units of memory.
+newdeque(MemDeque, umin);
+
+/// Capacity of a deque when it first grows from nothing.
+#define DEQUE_MIN_CAP 8
+
+/// The power of two capacity of a deque, for `count` elements.
+static inline usize deque_capacity(usize count)
+{
+	if (count <= DEQUE_MIN_CAP) return DEQUE_MIN_CAP;
+	return (usize)1 << (sizeof(usize) * CHAR_BIT - __builtin_clzl(count - 1));
+}
+
+/// Make room for at least `count` more elements.  Growing unwraps
+/// the ring into the larger buffer, moving the shorter of its two parts.
+/// @returns By how many elements the capacity grew.
+extern usize deque_reserve(u0 *self, usize count, usize width);
+/// Copy an element onto the back.
+/// @returns Pointer to the element, in the deque.
+extern u0 *push_back(u0 *self, const u0 *elem, usize width);
+/// Copy an element onto the front.
+/// @returns Pointer to the element, in the deque.
+extern u0 *push_front(u0 *self, const u0 *elem, usize width);
+/// Remove the last element, which must exist.
+/// @returns Pointer to the element, valid until the next push.
+extern u0 *pop_back(u0 *self, usize width);
+/// Remove the first element, which must exist.
+/// @returns Pointer to the element, valid until the next push.
+extern u0 *pop_front(u0 *self, usize width);
+/// Pointer to the element at `index` from the front, or `nil`.
+extern u0 *deque_get(const u0 *self, usize index, usize width);
+/// Split the elements in `[from, upto)` into the (at most) two
+/// contiguous runs of memory they occupy, without copying.
+/// @param[out] views Two slices, of which unused ones are emptied.
+/// @returns How many of the views are not empty.
+extern usize deque_views(const u0 *self, usize from, usize upto,
+                         MemSlice views[2], usize width);
+/// Free the buffer of a deque, and empty it.
+extern u0 deque_free(u0 *self, usize width);
+
+#ifdef CRELUDE_PROFILE
+	#define deque_reserve(...) PROFILE_CALL(deque_reserve, __VA_ARGS__)
+	#define push_back(...)     PROFILE_CALL(push_back, __VA_ARGS__)
+	#define push_front(...)    PROFILE_CALL(push_front, __VA_ARGS__)
+#endif
+
+/// Allocates a deque with room for (at least) `CAP` elements.
+#define DMAKE(TYPE, CAP) DMAKE_WITH(TYPE, CAP, nil)
+/// Allocates a deque, which will keep using `ALLOC`.
+#define DMAKE_WITH(TYPE, CAP, ALLOC) { \
+	.len = 0, \
+	.cap = deque_capacity(CAP), \
+	.head = 0, \
+	.alloc = (ALLOC), \
+	.value = eallocate((ALLOC), deque_capacity(CAP), sizeof(TYPE)) \
+}
+
+#define DFREE(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   deque_free(_self, sizeof(*_self->value)); })
+
+#define PUSH_BACK(SELF, ELEM) __extension__\
+	({ __auto_type           _self = &(SELF); \
+	   typeof(*_self->value) _elem =  (ELEM); \
+	   (typeof(_self->value))push_back(_self, &_elem, sizeof(_elem)); })
+
+#define PUSH_FRONT(SELF, ELEM) __extension__\
+	({ __auto_type           _self = &(SELF); \
+	   typeof(*_self->value) _elem =  (ELEM); \
+	   (typeof(_self->value))push_front(_self, &_elem, sizeof(_elem)); })
+
+#define POP_BACK(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   (typeof(_self->value))pop_back(_self, sizeof(*_self->value)); })
+
+#define POP_FRONT(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   (typeof(_self->value))pop_front(_self, sizeof(*_self->value)); })
+
+/// Pointer to the `INDEX`th element from the front, or `nil`.
+#define DGET(SELF, INDEX) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   (typeof(_self->value))deque_get(_self, (INDEX), \
+	       sizeof(*_self->value)); })
+
+/// Fill `VIEWS`, two `sliceof(T)`, with the runs of elements
+/// in `[FROM, UPTO)`.  Returns how many runs there are.
+/// e.g.
+/// ```c
+/// sliceof(int) runs[2];
+/// DVIEWS(queue, 0, queue.len, runs);
+/// FOR_EACH(x, runs[0]) ...;
+/// FOR_EACH(x, runs[1]) ...;
+/// ```
+#define DVIEWS(SELF, FROM, UPTO, VIEWS) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   _Static_assert(sizeof((VIEWS)[0]) == sizeof(MemSlice), \
+	       "views must be slices"); \
+	   deque_views(_self, (FROM), (UPTO), \
+	       (MemSlice *)(VIEWS), sizeof(*_self->value)); })
@@ -1,5 +1,6 @@
 #include "io.h"
 #include "common.h"
+#include "arena.h"
 #include "utf.h"
 
 #include <ctype.h>
@@ -75,7 +76,7 @@ static string LENGTH_SUBSPECIFIERS
 struct Formatter {
 	string flags;
 	string width;
-	string precision; ///< Without '.' character.
+	string precision; ///< Including the '.' character.
 	string length;
 	byte specifier;
 
@@ -83,18 +84,15 @@ struct Formatter {
 };
 unqualify(struct, Formatter);
 
-// NOTE: Allocates on heap.
-static string formatter_string(Formatter formatter)
+// NOTE: Allocates from the (scratch) arena.
+static string formatter_string(Arena *scratch, Formatter formatter)
 {
-	StringBuilder repr = AMAKE(byte, formatter.offset + 2);
+	StringBuilder repr = AMAKE_WITH(byte, formatter.offset + 3, &scratch->allocator);
 
 	push(&repr, "%", 1);
 	extend(&repr, &formatter.flags, 1);
 	extend(&repr, &formatter.width, 1);
-	unless (IS_EMPTY(formatter.precision)) {
-		push(&repr, ".", 1);
-		extend(&repr, &formatter.precision, 1);
-	}
+	extend(&repr, &formatter.precision, 1);
 	extend(&repr, &formatter.length, 1);
 	push(&repr, &formatter.specifier, 1);
 
@@ -161,17 +159,70 @@ static Formatter parse_formatter(string formatter)
 	});
 }
 
+/// Keep at most this many bytes of a thread's formatting buffer between calls.
+#define FORMAT_BUFFER_KEEP (64 * 1024)
+
+/// Each thread formats into its own buffer, which is reused between calls.
+static _Thread_local StringBuilder format_buffer = { 0 };
+static _Thread_local bool format_buffer_busy = false;
+
+/// Take the thread's formatting buffer, or the `fallback` if
+/// it is already in use (e.g. when panicking whilst formatting).
+static StringBuilder *take_format_buffer(StringBuilder *fallback)
+{
+	if (format_buffer_busy) {
+		*fallback = AEMPTY(StringBuilder);
+		return fallback;
+	}
+	format_buffer_busy = true;
+	format_buffer.len = 0;
+	if (format_buffer.cap == 0)
+		resize(&format_buffer, 256, sizeof(byte));
+	return &format_buffer;
+}
+
+static u0 give_format_buffer(StringBuilder *buffer)
+{
+	unless (buffer == &format_buffer) {
+		AFREE(*buffer);
+		return UNIT;
+	}
+	if (buffer->cap > FORMAT_BUFFER_KEEP)
+		resize(buffer, FORMAT_BUFFER_KEEP, sizeof(byte));
+	format_buffer_busy = false;
+}
+
+u0 free_format_buffer()
+{
+	unless (format_buffer_busy) AFREE(format_buffer);
+}
+
+static u0 format_into(StringBuilder *out, const byte *format, va_list args);
+
+/// Append formatted elements of `%D`/`%V` to the output.
+static u0 format_append(StringBuilder *out, const byte *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	format_into(out, format, args);
+	va_end(args);
+}
+
+/// Appends the formatted string to `out`, and NUL-terminates it
+/// (without counting the NUL-byte in the length).  All temporaries
+/// live in the scratch arena, and are gone once this returns.
 // TODO(maybe): Add a binary formatter.
-string novel_vsprintf(const byte *format, va_list args)
+static u0 format_into(StringBuilder *out, const byte *format, va_list args)
 {
-	newarray(ByteArray, byte);
-	ByteArray bytes = AMAKE(byte, strlen(format) + 64);
+	Arena *scratch = scratch_arena();
+	ArenaMark mark = arena_mark(scratch);
+	Allocator *temporary = &scratch->allocator;
 
 	usize i = 0;
 	byte c;
 	until ('\0' == (c = format[i++])) {
 		unless (c == '%') {
-			push(&bytes, &c, sizeof(byte));  // Other characters are preserved.
+			push(out, &c, sizeof(byte));  // Other characters are preserved.
 			continue;
 		}
 
@@ -186,31 +237,32 @@ string novel_vsprintf(const byte *format, va_list args)
 		switch (formatter.specifier) {
 		case 'S': {  // '%S', string slice formatter.
 			string value = va_arg(args, string);
-			extend(&bytes, &value, sizeof(byte));
+			extend(out, &value, sizeof(byte));
 		} break;
 		case 'C': {  // '%C', rune formatter.
 			rune value = va_arg(args, rune);
 			string ucs_bytes = INIT(byte, { 0, 0, 0, 0, 0 });
 			ucs_bytes = rune_to_utf8(ucs_bytes, value);
-			extend(&bytes, &ucs_bytes, sizeof(byte));
+			extend(out, &ucs_bytes, sizeof(byte));
 		} break;
 		case 'r': {  // '%r', runic (UCS-4) string formatter.
 			runic value = va_arg(args, runic);
-			string ucs_bytes = SMAKE(byte, 4 * (value.len + 1));
+			usize size = 4 * (value.len + 1);
+			string ucs_bytes = SMAKE_WITH(byte, size, temporary);
 			ucs_bytes = ucs4_to_utf8(ucs_bytes, value);
-			extend(&bytes, &ucs_bytes, sizeof(byte));
+			extend(out, &ucs_bytes, sizeof(byte));
 		} break;
 		case 'U': {  // '%U', runic 8-(hex)digit unicode codepoint formatter.
 			rune value = va_arg(args, rune);
 			byte res[] = "U+00000000";
 			string sliced = VIEW(string, res, 0, 10);
 			sprintf(res + 2, "%08X", value);
-			extend(&bytes, &sliced, sizeof(byte));
+			extend(out, &sliced, sizeof(byte));
 		} break;
 		case 'b': {  // '%b' boolean formatter.
 			int value = va_arg(args, int);  //< _Bool gets promoted to int.
 			string bool_string = value ? STR("true") : STR("false");
-			extend(&bytes, &bool_string, sizeof(byte));
+			extend(out, &bool_string, sizeof(byte));
 		} break;
 		case 'D':  // '%D{·}{·}' dynamic array type formatter.
 			// Following the 'D' must be the format specifier for the elements,
@@ -234,7 +286,7 @@ string novel_vsprintf(const byte *format, va_list args)
 				++i;  // Skip '}'.
 
 				// `elem_repr` must NUL-terminate, hence we make a copy.
-				byte *buf = emalloc(len, sizeof(byte));
+				byte *buf = arena_alloc(scratch, len + 1);
 				buf = memcpy(buf, format + begin, len * sizeof(byte));
 				buf[len] = '\0';
 				elem_repr = VIEW(string, buf, 0, len);
@@ -257,7 +309,7 @@ string novel_vsprintf(const byte *format, va_list args)
 				usize offs = elem_formatter.offset;
 
 				// `elem_repr` must NUL-terminate, hence we make a copy.
-				byte *buf = emalloc(offs + 2, sizeof(byte));
+				byte *buf = arena_alloc(scratch, offs + 2);
 				buf[0] = '%';
 				memcpy(buf + 1, format + i, offs * sizeof(byte));
 				buf[offs + 1] = '\0';
@@ -289,11 +341,9 @@ string novel_vsprintf(const byte *format, va_list args)
 				} \
 				for (usize n = 0; n < slice.len; ++n) { \
 					TYPE *elem = slice.value + n; \
-					string elem_str = novel_sprintf(elem_repr.value, *elem); \
-					extend(&bytes, &elem_str, sizeof(byte)); \
-					FREE(elem_str.value); \
+					format_append(out, elem_repr.value, *elem); \
 					unless (n == slice.len - 1) \
-						extend(&bytes, &delim, sizeof(byte)); \
+						extend(out, &delim, sizeof(byte)); \
 				} \
 			} while (false)
 
@@ -388,25 +438,31 @@ string novel_vsprintf(const byte *format, va_list args)
 					elem_formatter.specifier);
 				break;
 			}
-
-			FREE_INSIDE(elem_repr);
 		} break;
 		default: {
-			// Send it off to libc `vsprintf`.
-			string c_formatter = formatter_string(formatter);
+			// Send it off to libc `vsnprintf`, writing straight into
+			// the output, and only growing it when there is not enough room.
+			string c_formatter = formatter_string(scratch, formatter);
 			// We cannot pass in `va_list args` to the libc printf,
 			// since it is technically undefined behaviour to use a
 			// va_list after it's been passed by value into another
 			// variadic function.  We must make a copy, and skip it.
 			va_list args_copy;
+			usize room = out->cap - out->len;
 			va_copy(args_copy, args);
-			byte *buf;
-			isize len = vasprintf(&buf, c_formatter.value, args_copy);
+			isize len = vsnprintf(out->value + out->len, room,
+			                      c_formatter.value, args_copy);
 			va_end(args_copy);
-			string buf_slice = VIEW(string, buf, 0, len);
-			extend(&bytes, &buf_slice, sizeof(byte));
-			FREE(buf);
-			FREE(c_formatter.value);
+			if (len >= 0 && (usize)len >= room) {  // Grow, then try again.
+				usize end = out->len;
+				grow(out, len + 1, sizeof(byte));
+				out->len = end;
+				va_copy(args_copy, args);
+				vsnprintf(out->value + out->len, len + 1,
+				          c_formatter.value, args_copy);
+				va_end(args_copy);
+			}
+			if (len > 0) out->len += len;
 			// Skip/discard the argument!
 			switch (formatter.specifier) {
 			case 'i': case 'd':
@@ -486,12 +542,39 @@ string novel_vsprintf(const byte *format, va_list args)
 	}
 
 	// NUL-terminate the string slice.
-	push(&bytes, &NUL_BYTE, sizeof(byte));
-	--bytes.len;  //< But, don't count the NUL-byte as part of the length.
-	return SLICE(string, bytes, 0, -1);
+	push(out, &NUL_BYTE, sizeof(byte));
+	--out->len;  //< But, don't count the NUL-byte as part of the length.
+	arena_rewind(scratch, mark);
+}
+
+string (novel_vsprintf_with)(Allocator *allocator, const byte *format, va_list args)
+{
+	StringBuilder fallback;
+	StringBuilder *out = take_format_buffer(&fallback);
+	format_into(out, format, args);
+	// Copy out of the formatting buffer, into exactly `len + 1` bytes.
+	byte *res = allocate(allocator, out->len + 1);
+	if (res == nil)
+		PANIC("Could not allocate %zu bytes.", out->len + 1);
+	memcpy(res, out->value, out->len + 1);
+	string s = VIEW(string, res, 0, out->len);
+	give_format_buffer(out);
+	return s;
+}
+
+string (novel_vsprintf)(const byte *format, va_list args)
+{ return novel_vsprintf_with(nil, format, args); }
+
+string (novel_sprintf_with)(Allocator *allocator, const byte *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	string res = novel_vsprintf_with(allocator, format, args);
+	va_end(args);
+	return res;
 }
 
-string novel_sprintf(const byte *format, ...)
+string (novel_sprintf)(const byte *format, ...)
 {
 	va_list args;
 	va_start(args, format);
@@ -500,11 +583,29 @@ string novel_sprintf(const byte *format, ...)
 	return res;
 }
 
+string (novel_vsprintf_append)(u0 *builder, const byte *format, va_list args)
+{
+	StringBuilder *out = builder;
+	format_into(out, format, args);
+	return VIEW(string, out->value, 0, out->len);
+}
+
+string (novel_sprintf_append)(u0 *builder, const byte *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	string res = novel_vsprintf_append(builder, format, args);
+	va_end(args);
+	return res;
+}
+
 ierr novel_vfprintf(FILE *stream, const byte *format, va_list args)
 {
-	string s = novel_vsprintf(format, args);
-	ierr res = fputs(s.value, stream);
-	FREE(s.value);
+	StringBuilder fallback;
+	StringBuilder *out = take_format_buffer(&fallback);
+	format_into(out, format, args);
+	ierr res = fputs(out->value, stream);
+	give_format_buffer(out);
 	return res;
 }
 
@@ -10,6 +10,8 @@
 
 #define print(...) novel_fprintf(stdout, __VA_ARGS__)
 #define sprint novel_sprintf
+#define sprint_with novel_sprintf_with
+#define sprint_append novel_sprintf_append
 #define println(...) novel_fprintf_newline(stdout, __VA_ARGS__)
 #define eprintf(...) novel_fprintf(stderr, __VA_ARGS__)
 #define eprint(...) eprintf(__VA_ARGS__)
@@ -28,14 +30,43 @@ extern ierr eputs(const byte *);
 /// Custom `printf` for other data-types.
 /// @note Heap allocates memory, should be freed after printing.
 extern string novel_vsprintf(const byte *, va_list);
+/// Like `novel_vsprintf`, but the result is copied out of the thread's
+/// format buffer (temporaries going in its scratch arena) with the given
+/// allocator, being all it is used for.  The result occupies `len + 1`
+/// bytes, i.e. free it with `deallocate(allocator, s.value, s.len + 1)`.
+extern string novel_vsprintf_with(Allocator *, const byte *, va_list);
 /// @note Returns heap-allocated memory, should be freed.
 extern string novel_sprintf(const byte *, ...);
+/// Like `novel_sprintf`, with the given allocator.
+extern string novel_sprintf_with(Allocator *, const byte *, ...);
+/// Formats onto the end of a `StringBuilder` (or a small array of bytes),
+/// growing it with its own allocator, and keeps it NUL-terminated.
+/// @returns The whole of the builder's contents, as a string.
+extern string novel_vsprintf_append(u0 *builder, const byte *, va_list);
+/// Like `novel_vsprintf_append`, with variadic arguments.
+extern string novel_sprintf_append(u0 *builder, const byte *, ...);
 extern ierr novel_vfprintf(FILE *, const byte *, va_list);
 extern ierr novel_fprintf(FILE *, const byte *, ...);
 extern ierr novel_vfprintf_newline(FILE *, const byte *, va_list);
 extern ierr novel_fprintf_newline(FILE *, const byte *, ...);
 extern ierr novel_printf(const byte *, ...);
 
+/// Formatting happens in a buffer owned by the calling thread, which is
+/// reused by every call (temporaries go in its scratch arena).
+/// This gives that buffer back to the system, e.g. before a thread exits.
+extern u0 free_format_buffer(void);
+
+#ifdef CRELUDE_PROFILE
+	#define novel_vsprintf(...)      PROFILE_CALL(novel_vsprintf, __VA_ARGS__)
+	#define novel_vsprintf_with(...) PROFILE_CALL(novel_vsprintf_with, __VA_ARGS__)
+	#define novel_sprintf(...)       PROFILE_CALL(novel_sprintf, __VA_ARGS__)
+	#define novel_sprintf_with(...)  PROFILE_CALL(novel_sprintf_with, __VA_ARGS__)
+	#define novel_vsprintf_append(...) \
+		PROFILE_CALL(novel_vsprintf_append, __VA_ARGS__)
+	#define novel_sprintf_append(...) \
+		PROFILE_CALL(novel_sprintf_append, __VA_ARGS__)
+#endif
+
 /// Size of the type of a `printf`-style format specifer.
 /// e.g. `sizeof_specifier("hx") == sizeof(unsigned short int);`.
 extern usize sizeof_specifier(const byte *);
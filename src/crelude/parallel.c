@@ -0,0 +1,38 @@
+#include "parallel.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+usize parallel_grain(usize len, usize width)
+{
+	width = max(width, (usize)1);
+	if (len * width <= PARALLEL_SERIAL_BYTES)
+		return max(len, (usize)1);
+	return max(PARALLEL_GRAIN_BYTES / width, (usize)1);
+}
+
+record(Grains) {
+	usize len, grain;
+	u0 (*body)(u0 *context, usize from, usize upto);
+	u0 *context;
+};
+
+static u0 run_grain(u0 *context, usize index)
+{
+	Grains *grains = context;
+	usize from = index * grains->grain;
+	grains->body(grains->context, from, min(from + grains->grain, grains->len));
+}
+
+u0 parallel_for(usize len, usize grain,
+                u0 (*body)(u0 *context, usize from, usize upto), u0 *context)
+{
+	if (len <= grain) {
+		body(context, 0, len);
+		return UNIT;
+	}
+	Grains grains = { len, grain, body, context };
+	workers_run(workers_default(), (len + grain - 1) / grain, run_grain, &grains);
+}
+
+#endif
@@ -0,0 +1,240 @@
+//! @file parallel.h
+//! Parallel counterparts of `SMAP` and friends, run on the shared pool
+//! of workers (see thread.h).  Work is split into grains of about
+//! `PARALLEL_GRAIN_BYTES` of input each, which the threads take in turn,
+//! and inputs which fit in a few grains are done serially instead.
+//! e.g.
+//! ```c
+//! #define ADD(A, B) ((A) + (B))
+//! sliceof(f64) roots = PMAP(sliceof(f64), sqrt, xs);
+//! f64 total = PREDUCE(roots, 0.0, ADD);
+//! usize kept = PPARTITION(records, is_valid);  //< valid ones first.
+//! ```
+//! `FUNC`, `OP` and `PRED` are called directly, so may be inlined, or
+//! be macros.  They are called from many threads at once, and in no
+//! particular order, so should not have side effects on shared state.
+//! `OP` must be associative, and have `INIT` as its identity
+//! (e.g. `0` for addition), but needn't be commutative.
+
+#pragma once
+#include "common.h"
+#include "thread.h"
+
+/// Input per grain of work, in bytes: about what fits in a core's
+/// L2 cache, alongside the output.
+#define PARALLEL_GRAIN_BYTES (128 * 1024)
+/// Inputs up to this many bytes are done serially.
+#define PARALLEL_SERIAL_BYTES (4 * PARALLEL_GRAIN_BYTES)
+
+/// Number of elements of `width` bytes in each grain, being all `len`
+/// of them if the input is small.
+extern usize parallel_grain(usize len, usize width);
+/// Run `body(context, from, upto)` over every grain `[from, upto)` of
+/// `[0, len)`, spread over the shared pool, and wait for them all.
+/// A single grain is run directly by the calling thread.
+extern u0 parallel_for(usize len, usize grain,
+                       u0 (*body)(u0 *context, usize from, usize upto), u0 *context);
+
+#define PARALLEL_GRAINS_(LEN, GRAIN) ((LEN) == 0 ? 0 : ((LEN) + (GRAIN) - 1) / (GRAIN))
+
+/// Like `SMAP`, but in parallel, into a new slice of type `T`.
+#define PMAP(T, FUNC, LIST) __extension__({ \
+	T _pmapped; \
+	__auto_type _plist = (LIST); \
+	_pmapped = ((T)SMAKE(typeof(*_pmapped.value), _plist.len)); \
+	struct { typeof(_plist) in; typeof(_pmapped) out; } _pmap = { _plist, _pmapped }; \
+	u0 _pmap_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_pmap) *_pm = _pctx; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) \
+			_pm->out.value[_pi] = FUNC(_pm->in.value[_pi]); \
+	} \
+	parallel_for(_plist.len, parallel_grain(_plist.len, sizeof(*_plist.value)), \
+		_pmap_grain, &_pmap); \
+	_pmapped; \
+})
+
+/// Call `FUNC(ptr)` with a pointer to every element of an array or
+/// slice, in parallel.
+#define PFOR_EACH(SELF, FUNC) __extension__({ \
+	__auto_type _pself = (SELF); \
+	u0 _peach_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_pself) *_pe = _pctx; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) \
+			FUNC(&_pe->value[_pi]); \
+	} \
+	parallel_for(_pself.len, parallel_grain(_pself.len, sizeof(*_pself.value)), \
+		_peach_grain, &_pself); \
+	UNIT; \
+})
+
+/// Combine every element of an array or slice, with `OP(acc, elem)`,
+/// starting from `INIT`, in parallel.  Each grain is reduced on its own,
+/// and the results are then combined in order.
+#define PREDUCE(LIST, INIT, OP) __extension__({ \
+	__auto_type _plist = (LIST); \
+	typeof(INIT) _pinit = (INIT); \
+	usize _pgrain = parallel_grain(_plist.len, sizeof(*_plist.value)); \
+	usize _pgrains = PARALLEL_GRAINS_(_plist.len, _pgrain); \
+	struct { typeof(_plist) in; typeof(_pinit) init, *partials; usize grain; } _pred = { \
+		_plist, _pinit, emalloc(max(_pgrains, (usize)1), sizeof(_pinit)), _pgrain \
+	}; \
+	u0 _preduce_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_pred) *_pr = _pctx; \
+		typeof(_pinit) _pacc = _pr->init; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) \
+			_pacc = OP(_pacc, _pr->in.value[_pi]); \
+		_pr->partials[_pfrom / _pr->grain] = _pacc; \
+	} \
+	parallel_for(_plist.len, _pgrain, _preduce_grain, &_pred); \
+	typeof(_pinit) _presult = _pinit; \
+	for (usize _pi = 0; _pi < _pgrains; ++_pi) \
+		_presult = OP(_presult, _pred.partials[_pi]); \
+	FREE(_pred.partials); \
+	_presult; \
+})
+
+#define PSCAN_(SELF, INIT, OP, EXCLUSIVE) __extension__({ \
+	__auto_type _pself = &(SELF); \
+	typeof(*_pself->value) _pinit = (INIT); \
+	usize _pgrain = parallel_grain(_pself->len, sizeof(_pinit)); \
+	usize _pgrains = PARALLEL_GRAINS_(_pself->len, _pgrain); \
+	struct { typeof(_pself) self; typeof(_pinit) init, *partials; usize grain; } _pscan = { \
+		_pself, _pinit, emalloc(max(_pgrains, (usize)1), sizeof(_pinit)), _pgrain \
+	}; \
+	u0 _psum_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_pscan) *_ps = _pctx; \
+		typeof(_pinit) _pacc = _ps->init; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) \
+			_pacc = OP(_pacc, _ps->self->value[_pi]); \
+		_ps->partials[_pfrom / _ps->grain] = _pacc; \
+	} \
+	u0 _pscan_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_pscan) *_ps = _pctx; \
+		typeof(_pinit) _pacc = _ps->partials[_pfrom / _ps->grain]; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) { \
+			typeof(_pinit) _px = _ps->self->value[_pi]; \
+			if (EXCLUSIVE) _ps->self->value[_pi] = _pacc; \
+			_pacc = OP(_pacc, _px); \
+			if (!(EXCLUSIVE)) _ps->self->value[_pi] = _pacc; \
+		} \
+	} \
+	/* Sum up each grain, then scan the sums into where each starts. */ \
+	_pscan.partials[0] = _pinit; \
+	if (_pgrains > 1) { \
+		parallel_for(_pself->len, _pgrain, _psum_grain, &_pscan); \
+		typeof(_pinit) _poffset = _pinit; \
+		for (usize _pi = 0; _pi < _pgrains; ++_pi) { \
+			typeof(_pinit) _psum = _pscan.partials[_pi]; \
+			_pscan.partials[_pi] = _poffset; \
+			_poffset = OP(_poffset, _psum); \
+		} \
+	} \
+	parallel_for(_pself->len, _pgrain, _pscan_grain, &_pscan); \
+	FREE(_pscan.partials); \
+	*_pself; \
+})
+
+/// In-place inclusive prefix scan, in parallel: every element becomes
+/// `OP` of itself and all those before it.
+#define PSCAN(SELF, INIT, OP) PSCAN_(SELF, INIT, OP, false)
+/// In-place exclusive prefix scan, in parallel: every element becomes
+/// `OP` of all those before it (the first becoming `INIT`).
+#define PSCAN_EXCLUSIVE(SELF, INIT, OP) PSCAN_(SELF, INIT, OP, true)
+
+/// Count the elements of each grain for which `PRED` holds,
+/// into `where`, then scan these into where each grain's go.
+#define PCOUNT_GRAINS_(P, PRED) do { \
+	u0 _pcount_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(P) *_pp = _pctx; \
+		usize _pcount = 0; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) \
+			_pcount += (bool)PRED(_pp->in.value[_pi]); \
+		_pp->where[_pfrom / _pp->grain] = _pcount; \
+	} \
+	parallel_for((P).in.len, (P).grain, _pcount_grain, &(P)); \
+	(P).kept = 0; \
+	for (usize _pi = 0; _pi < (P).grains; ++_pi) { \
+		usize _pcount = (P).where[_pi]; \
+		(P).where[_pi] = (P).kept; \
+		(P).kept += _pcount; \
+	} \
+} while (0)
+
+/// Move the elements of an array or slice for which `PRED` holds
+/// before those for which it does not, in parallel, keeping the order
+/// within each part.  Needs a buffer as large as the array.
+/// @returns The number of elements for which `PRED` holds.
+#define PPARTITION(SELF, PRED) __extension__({ \
+	__auto_type _pself = &(SELF); \
+	usize _pgrain = parallel_grain(_pself->len, sizeof(*_pself->value)); \
+	usize _pgrains = PARALLEL_GRAINS_(_pself->len, _pgrain); \
+	struct { \
+		typeof(*_pself) in; \
+		typeof(_pself->value) out; \
+		usize *where, grain, grains, kept; \
+	} _ppart = { \
+		*_pself, emalloc(max(_pself->len, (usize)1), sizeof(*_pself->value)), \
+		emalloc(max(_pgrains, (usize)1), sizeof(usize)), _pgrain, _pgrains, 0 \
+	}; \
+	PCOUNT_GRAINS_(_ppart, PRED); \
+	u0 _pscatter_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_ppart) *_pp = _pctx; \
+		usize _pyes = _pp->where[_pfrom / _pp->grain]; \
+		usize _pno = _pp->kept + _pfrom - _pyes; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) { \
+			typeof(*_pp->out) _px = _pp->in.value[_pi]; \
+			bool _pkeep = PRED(_px); \
+			_pp->out[_pkeep ? _pyes : _pno] = _px; \
+			_pyes += _pkeep; \
+			_pno += !_pkeep; \
+		} \
+	} \
+	u0 _pcopy_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_ppart) *_pp = _pctx; \
+		memcpy(_pp->in.value + _pfrom, _pp->out + _pfrom, \
+			(_pupto - _pfrom) * sizeof(*_pp->out)); \
+	} \
+	parallel_for(_pself->len, _pgrain, _pscatter_grain, &_ppart); \
+	parallel_for(_pself->len, _pgrain, _pcopy_grain, &_ppart); \
+	FREE(_ppart.out); \
+	FREE(_ppart.where); \
+	_ppart.kept; \
+})
+
+/// A new slice of type `T`, of the elements of `LIST` for which `PRED`
+/// holds, in order, found in parallel.
+#define PFILTER(T, PRED, LIST) __extension__({ \
+	T _pfiltered; \
+	__auto_type _plist = (LIST); \
+	usize _pgrain = parallel_grain(_plist.len, sizeof(*_plist.value)); \
+	usize _pgrains = PARALLEL_GRAINS_(_plist.len, _pgrain); \
+	struct { \
+		typeof(_plist) in; \
+		typeof(_pfiltered.value) out; \
+		usize *where, grain, grains, kept; \
+	} _pfilt = { \
+		_plist, nil, emalloc(max(_pgrains, (usize)1), sizeof(usize)), _pgrain, _pgrains, 0 \
+	}; \
+	PCOUNT_GRAINS_(_pfilt, PRED); \
+	_pfiltered = ((T)SMAKE(typeof(*_pfiltered.value), _pfilt.kept)); \
+	_pfilt.out = _pfiltered.value; \
+	u0 _pgather_grain(u0 *_pctx, usize _pfrom, usize _pupto) \
+	{ \
+		typeof(_pfilt) *_pf = _pctx; \
+		usize _pyes = _pf->where[_pfrom / _pf->grain]; \
+		for (usize _pi = _pfrom; _pi < _pupto; ++_pi) \
+			if (PRED(_pf->in.value[_pi])) \
+				_pf->out[_pyes++] = _pf->in.value[_pi]; \
+	} \
+	parallel_for(_plist.len, _pgrain, _pgather_grain, &_pfilt); \
+	FREE(_pfilt.where); \
+	_pfiltered; \
+})
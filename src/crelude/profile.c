@@ -0,0 +1,272 @@
+#include "profile.h"
+
+#ifndef IMPLEMENTATION
+#ifdef CRELUDE_PROFILE
+
+// The profiler's own tables are kept with plain `malloc`, `realloc` and
+// `free`, such that they do not show up in (or recurse into) the report.
+
+/// A live block, and the site it was allocated at.
+record(ProfiledBlock) {
+	u0 *ptr;
+	usize bytes;
+	usize site;
+};
+
+static struct {
+	AllocStats *sites;
+	usize sites_len, sites_cap;
+	usize *site_index;  ///< Open-addressed, holds `site + 1`, or zero.
+	usize site_index_cap;
+	ProfiledBlock *blocks;  ///< Open-addressed by `ptr`, `nil` if empty.
+	usize blocks_len, blocks_cap;
+} profile = { 0 };
+
+static bool profile_lock = false;
+static _Thread_local AllocSite current_site = { 0 };
+
+static u0 lock(void)
+{
+	while (__atomic_test_and_set(&profile_lock, __ATOMIC_ACQUIRE))
+		;  // spin.
+}
+
+static u0 unlock(void)
+{ __atomic_clear(&profile_lock, __ATOMIC_RELEASE); }
+
+bool profile_enter(AllocSite site)
+{
+	unless (current_site.api == nil) return false;
+	current_site = site;
+	return true;
+}
+
+u0 profile_leave(bool outer)
+{
+	if (outer) current_site = (AllocSite){ 0 };
+}
+
+static usize hash_site(AllocSite site)
+{
+	usize h = site.line * 0x9E3779B97F4A7C15ull;
+	for (const byte *c = site.api; *c != NUL; ++c)
+		h = (h ^ *c) * 0x100000001B3ull;
+	return h ^ (h >> 29);
+}
+
+static bool same_site(AllocSite a, AllocSite b)
+{
+	return a.line == b.line
+	    && strcmp(a.api, b.api) == 0
+	    && strcmp(a.file, b.file) == 0;
+}
+
+static usize *find_site_slot(usize *index, usize cap, AllocSite site)
+{
+	usize mask = cap - 1;
+	for (usize i = hash_site(site) & mask;; i = (i + 1) & mask) {
+		usize *slot = &index[i];
+		if (*slot == 0 || same_site(profile.sites[*slot - 1].site, site))
+			return slot;
+	}
+}
+
+/// Index of the statistics for `site`, which are created if new.
+static usize site_of(AllocSite site)
+{
+	if (2 * (profile.sites_len + 1) > profile.site_index_cap) {
+		usize cap = max(2 * profile.site_index_cap, (usize)64);
+		usize *index = calloc(cap, sizeof(usize));
+		for (usize i = 0; i < profile.sites_len; ++i)
+			*find_site_slot(index, cap, profile.sites[i].site) = i + 1;
+		free(profile.site_index);
+		profile.site_index = index;
+		profile.site_index_cap = cap;
+	}
+	usize *slot = find_site_slot(profile.site_index,
+		profile.site_index_cap, site);
+	unless (*slot == 0) return *slot - 1;
+
+	if (profile.sites_len == profile.sites_cap) {
+		profile.sites_cap = max(2 * profile.sites_cap, (usize)32);
+		profile.sites = realloc(profile.sites,
+			profile.sites_cap * sizeof(AllocStats));
+	}
+	profile.sites[profile.sites_len] = (AllocStats){ .site = site };
+	*slot = ++profile.sites_len;
+	return *slot - 1;
+}
+
+static inline usize hash_ptr(const u0 *ptr)
+{
+	usize h = (uptr)ptr * 0x9E3779B97F4A7C15ull;
+	return h ^ (h >> 32);
+}
+
+static ProfiledBlock *find_block(ProfiledBlock *blocks, usize cap, const u0 *ptr)
+{
+	usize mask = cap - 1;
+	for (usize i = hash_ptr(ptr) & mask;; i = (i + 1) & mask)
+		if (blocks[i].ptr == nil || blocks[i].ptr == ptr)
+			return &blocks[i];
+}
+
+static u0 track(u0 *ptr, usize bytes, usize site)
+{
+	if (4 * (profile.blocks_len + 1) > 3 * profile.blocks_cap) {
+		usize cap = max(2 * profile.blocks_cap, (usize)1024);
+		ProfiledBlock *blocks = calloc(cap, sizeof(ProfiledBlock));
+		for (usize i = 0; i < profile.blocks_cap; ++i)
+			unless (profile.blocks[i].ptr == nil)
+				*find_block(blocks, cap, profile.blocks[i].ptr) = profile.blocks[i];
+		free(profile.blocks);
+		profile.blocks = blocks;
+		profile.blocks_cap = cap;
+	}
+	*find_block(profile.blocks, profile.blocks_cap, ptr) = (ProfiledBlock){
+		.ptr = ptr, .bytes = bytes, .site = site
+	};
+	++profile.blocks_len;
+
+	AllocStats *stats = &profile.sites[site];
+	stats->calls += 1;
+	stats->bytes += bytes;
+	stats->live += bytes;
+	stats->peak = max(stats->peak, stats->live);
+}
+
+/// Stop tracking a block.
+/// @returns The block's entry, with a `nil` pointer if it was not tracked.
+static ProfiledBlock forget(u0 *ptr)
+{
+	if (profile.blocks_cap == 0) return (ProfiledBlock){ 0 };
+	ProfiledBlock *block = find_block(profile.blocks, profile.blocks_cap, ptr);
+	ProfiledBlock forgotten = *block;
+	if (block->ptr == nil) return forgotten;  // Allocated before profiling.
+
+	// Shift later entries of the probe sequence back, in place of tombstones.
+	usize mask = profile.blocks_cap - 1;
+	usize hole = block - profile.blocks;
+	for (usize i = (hole + 1) & mask; profile.blocks[i].ptr != nil; i = (i + 1) & mask) {
+		usize home = hash_ptr(profile.blocks[i].ptr) & mask;
+		// Move the entry if its home is not within (hole, i].
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			profile.blocks[hole] = profile.blocks[i];
+			hole = i;
+		}
+	}
+	profile.blocks[hole].ptr = nil;
+	--profile.blocks_len;
+	return forgotten;
+}
+
+/// Credit the site of a forgotten block with its freeing.
+static u0 freed(ProfiledBlock block)
+{
+	if (block.ptr == nil) return UNIT;
+	AllocStats *stats = &profile.sites[block.site];
+	stats->live -= block.bytes;
+	stats->frees += 1;
+}
+
+/// The site of the outermost profiled call, otherwise that of the caller.
+static AllocSite site_or(AllocSite site)
+{ return current_site.api == nil ? site : current_site; }
+
+u0 *profile_malloc(AllocSite site, usize bytes)
+{
+	u0 *ptr = malloc(bytes);
+	if (ptr == nil) return nil;
+	lock();
+	track(ptr, bytes, site_of(site_or(site)));
+	unlock();
+	return ptr;
+}
+
+u0 *profile_realloc(AllocSite site, u0 *ptr, usize bytes)
+{
+	// Keep the lock, such that the old address is not handed out
+	// again (by another thread) before it has been forgotten.
+	lock();
+	ProfiledBlock old = forget(ptr);
+	u0 *new = realloc(ptr, bytes);
+	if (new == nil && bytes > 0) {  // Failed, the old block is still there.
+		unless (old.ptr == nil) {
+			*find_block(profile.blocks, profile.blocks_cap, old.ptr) = old;
+			++profile.blocks_len;
+		}
+	} else {
+		freed(old);
+		unless (new == nil) track(new, bytes, site_of(site_or(site)));
+	}
+	unlock();
+	return new;
+}
+
+u0 profile_free(u0 *ptr)
+{
+	if (ptr == nil) return UNIT;
+	lock();
+	freed(forget(ptr));
+	unlock();
+	free(ptr);
+}
+
+AllocStats profile_totals(const byte *api)
+{
+	AllocStats totals = { .site = { .api = api } };
+	lock();
+	for (usize i = 0; i < profile.sites_len; ++i) {
+		AllocStats *stats = &profile.sites[i];
+		unless (api == nil || strcmp(stats->site.api, api) == 0)
+			continue;
+		totals.calls += stats->calls;
+		totals.frees += stats->frees;
+		totals.bytes += stats->bytes;
+		totals.live  += stats->live;
+		totals.peak  += stats->peak;
+	}
+	unlock();
+	return totals;
+}
+
+static int by_bytes(const u0 *a, const u0 *b)
+{
+	const AllocStats *x = a, *y = b;
+	return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+u0 profile_dump(FILE *stream)
+{
+	lock();
+	usize len = profile.sites_len;
+	AllocStats *sites = malloc(max(len, (usize)1) * sizeof(AllocStats));
+	memcpy(sites, profile.sites, len * sizeof(AllocStats));
+	unlock();
+
+	qsort(sites, len, sizeof(AllocStats), by_bytes);
+	fprintf(stream, "%10s %10s %12s %12s %12s  %s\n",
+		"calls", "frees", "bytes", "live", "peak", "site");
+	for (usize i = 0; i < len; ++i) {
+		AllocStats *s = &sites[i];
+		if (s->calls == 0 && s->live == 0) continue;  // Nothing to report.
+		fprintf(stream, "%10zu %10zu %12zu %12zu %12zu  %s (%s:%u in %s)\n",
+			s->calls, s->frees, s->bytes, s->live, s->peak,
+			s->site.api, s->site.file, s->site.line, s->site.func);
+	}
+	free(sites);
+}
+
+u0 profile_reset()
+{
+	lock();
+	for (usize i = 0; i < profile.sites_len; ++i) {
+		AllocStats *stats = &profile.sites[i];
+		stats->calls = stats->frees = stats->bytes = 0;
+		stats->peak = stats->live;
+	}
+	unlock();
+}
+
+#endif
+#endif
@@ -0,0 +1,76 @@
+//! @file profile.h
+//! Allocation profiler, for builds with `CRELUDE_PROFILE` defined
+//! (e.g. `make PROFILE=1`).  `MALLOC`, `REALLOC` and `FREE` are wrapped
+//! to keep per-call-site counts of allocations, total bytes, bytes still
+//! live, and the peak of live bytes.
+//!
+//! The allocating entry points (`allocate`, `emalloc`, `grow`, `associate`,
+//! `novel_sprintf`, `base64_encode`, ...) become macros that note down
+//! where they were called from, such that allocations are attributed to
+//! the outermost call, instead of some internal helper.  These functions
+//! are defined with their names in parentheses, e.g. `(associate)(...)`,
+//! which keeps the macros from applying to the definitions themselves.
+//! e.g.
+//! ```c
+//! profile_reset();
+//! run_workload();
+//! profile_dump(stderr);
+//! ```
+
+#pragma once
+#include "common.h"
+
+/// Source location of an allocating call.
+record(AllocSite) {
+	const byte *file;
+	const byte *func;  ///< Function the call was made from.
+	const byte *api;   ///< Allocating function called, e.g. `"grow"`.
+	u32 line;
+};
+
+/// Statistics of the allocations made at a site.
+record(AllocStats) {
+	AllocSite site;
+	usize calls;  ///< Allocations and reallocations made.
+	usize frees;  ///< Blocks allocated here that have been freed.
+	usize bytes;  ///< Total bytes requested.
+	usize live;   ///< Bytes allocated here that are yet to be freed.
+	usize peak;   ///< Greatest value `live` has taken.
+};
+
+#define PROFILE_SITE(API) ((AllocSite){ \
+	.file = __FILE__, .func = __func__, .api = (API), .line = __LINE__ })
+
+/// Call `FUNC` with the given arguments, attributing what it allocates
+/// to the current line, unless an outer call is being profiled already.
+#define PROFILE_CALL(FUNC, ...) __extension__\
+	({ bool _outer = profile_enter(PROFILE_SITE(#FUNC)); \
+	   __auto_type _result = (FUNC)(__VA_ARGS__); \
+	   profile_leave(_outer); \
+	   _result; })
+/// Like `PROFILE_CALL`, but for functions returning `u0`.
+#define PROFILE_CALL_U0(FUNC, ...) __extension__\
+	({ bool _outer = profile_enter(PROFILE_SITE(#FUNC)); \
+	   (FUNC)(__VA_ARGS__); \
+	   profile_leave(_outer); })
+
+/// Attribute allocations on this thread to `site`, if none is set.
+/// @returns Whether the site was set, and should be left afterwards.
+extern bool profile_enter(AllocSite site);
+/// Stop attributing allocations to the site set by `profile_enter`.
+extern u0 profile_leave(bool outer);
+
+/// `malloc`, recording the allocation at the current site.
+extern u0 *profile_malloc(AllocSite site, usize bytes);
+/// `realloc`, recording the reallocation at the current site.
+extern u0 *profile_realloc(AllocSite site, u0 *ptr, usize bytes);
+/// `free`, crediting the site that allocated the block.
+extern u0 profile_free(u0 *ptr);
+
+/// Sum the statistics of every site calling `api` (or of all, if `nil`).
+extern AllocStats profile_totals(const byte *api);
+/// Print a report of every site, the most bytes allocated first.
+extern u0 profile_dump(FILE *stream);
+/// Clear counts, and bring peaks down to what is live right now.
+/// Blocks which are still live keep being tracked.
+extern u0 profile_reset(void);
@@ -0,0 +1,223 @@
+#include "search.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+/// Whether `*x` goes before `*key` (or, if `upper`, not after it).
+static inline bool goes_before(const umin *x, const u0 *key, bool upper, Comparison compare)
+{
+	int order = compare(x, key);
+	return upper ? order <= 0 : order < 0;
+}
+
+/// Number of elements of `xs` which go before `*key`, by bisection.
+static usize bound(const umin *xs, usize len, usize width,
+                   const u0 *key, bool upper, Comparison compare)
+{
+	if (len == 0) return 0;
+	const umin *base = xs;
+	while (len > 1) {
+		usize half = len / 2;
+		base += goes_before(base + half * width, key, upper, compare) * half * width;
+		len -= half;
+	}
+	return (base - xs) / width + goes_before(base, key, upper, compare);
+}
+
+/// Likewise, but searching outward from the start of `xs`,
+/// so it is quicker the fewer elements there are to skip.
+static usize gallop(const umin *xs, usize len, usize width,
+                    const u0 *key, bool upper, Comparison compare)
+{
+	usize lo = 0, hi = 1;
+	while (hi < len && goes_before(xs + hi * width, key, upper, compare)) {
+		lo = hi + 1;
+		hi = 2 * hi + 1;
+	}
+	hi = min(hi, len);
+	return lo + bound(xs + lo * width, hi - lo, width, key, upper, compare);
+}
+
+usize lower_bound(const u0 *self, usize width, const u0 *key, Comparison compare)
+{
+	const MemSlice *xs = self;
+	return bound(xs->value, xs->len, width, key, false, compare);
+}
+
+usize upper_bound(const u0 *self, usize width, const u0 *key, Comparison compare)
+{
+	const MemSlice *xs = self;
+	return bound(xs->value, xs->len, width, key, true, compare);
+}
+
+Range equal_range(const u0 *self, usize width, const u0 *key, Comparison compare)
+{
+	const MemSlice *xs = self;
+	usize from = bound(xs->value, xs->len, width, key, false, compare);
+	usize upto = from + gallop(xs->value + from * width, xs->len - from,
+		width, key, true, compare);
+	return (Range){ from, upto };
+}
+
+/// Two sorted inputs, and the end of an array being appended to,
+/// as byte pointers.
+record(SortedInputs) {
+	const umin *a, *end_a;
+	const umin *b, *end_b;
+	umin *out, *start;
+};
+
+static SortedInputs sorted_inputs(MemArray *out, const MemSlice *a, const MemSlice *b,
+                                  usize room, usize width)
+{
+	reserve(out, room, width);
+	umin *end = out->value + out->len * width;
+	return (SortedInputs){
+		.a = a->value, .end_a = a->value + a->len * width,
+		.b = b->value, .end_b = b->value + b->len * width,
+		.out = end, .start = end
+	};
+}
+
+/// Copy what is left of either input (if asked to),
+/// and finish appending to `out`.
+static usize sorted_finish(MemArray *out, SortedInputs *in, bool rest_of_a, bool rest_of_b,
+                           usize width)
+{
+	if (rest_of_a) {
+		memcpy(in->out, in->a, in->end_a - in->a);
+		in->out += in->end_a - in->a;
+	}
+	if (rest_of_b) {
+		memcpy(in->out, in->b, in->end_b - in->b);
+		in->out += in->end_b - in->b;
+	}
+	usize count = (in->out - in->start) / width;
+	out->len += count;
+	return count;
+}
+
+usize (sorted_merge)(u0 *out, const u0 *a, const u0 *b, usize width, Comparison compare)
+{
+	const MemSlice *as = a, *bs = b;
+	SortedInputs in = sorted_inputs(out, as, bs, as->len + bs->len, width);
+	usize run_a = 0, run_b = 0;
+	while (in.a < in.end_a && in.b < in.end_b) {
+		if ((run_a | run_b) >= SEARCH_GALLOP_AFTER) {
+			// Copy the whole run at once.
+			usize bytes;
+			if (run_a > run_b) {
+				bytes = width * gallop(in.a, (in.end_a - in.a) / width, width, in.b, true, compare);
+				memcpy(in.out, in.a, bytes);
+				in.a += bytes;
+			} else {
+				bytes = width * gallop(in.b, (in.end_b - in.b) / width, width, in.a, false, compare);
+				memcpy(in.out, in.b, bytes);
+				in.b += bytes;
+			}
+			in.out += bytes;
+			run_a = run_b = 0;
+			continue;
+		}
+		bool take_b = compare(in.b, in.a) < 0;
+		memcpy(in.out, take_b ? in.b : in.a, width);
+		in.out += width;
+		in.a += !take_b * width;
+		in.b += take_b * width;
+		run_a = (run_a + 1) & -(usize)!take_b;
+		run_b = (run_b + 1) & -(usize)take_b;
+	}
+	return sorted_finish(out, &in, true, true, width);
+}
+
+usize (sorted_union)(u0 *out, const u0 *a, const u0 *b, usize width, Comparison compare)
+{
+	const MemSlice *as = a, *bs = b;
+	SortedInputs in = sorted_inputs(out, as, bs, as->len + bs->len, width);
+	while (in.a < in.end_a && in.b < in.end_b) {
+		int order = compare(in.a, in.b);
+		memcpy(in.out, order > 0 ? in.b : in.a, width);
+		in.out += width;
+		in.a += (order <= 0) * width;
+		in.b += (order >= 0) * width;
+	}
+	return sorted_finish(out, &in, true, true, width);
+}
+
+usize (sorted_intersect)(u0 *out, const u0 *a, const u0 *b, usize width, Comparison compare)
+{
+	const MemSlice *as = a, *bs = b;
+	SortedInputs in = sorted_inputs(out, as, bs, min(as->len, bs->len), width);
+	if (bs->len / SEARCH_GALLOP_RATIO > as->len) {
+		for (; in.a < in.end_a && in.b < in.end_b; in.a += width) {
+			in.b += width * gallop(in.b, (in.end_b - in.b) / width, width, in.a, false, compare);
+			bool found = in.b < in.end_b && compare(in.a, in.b) == 0;
+			memcpy(in.out, in.a, width);
+			in.out += found * width;
+			in.b += found * width;
+		}
+	} else if (as->len / SEARCH_GALLOP_RATIO > bs->len) {
+		for (; in.a < in.end_a && in.b < in.end_b; in.b += width) {
+			in.a += width * gallop(in.a, (in.end_a - in.a) / width, width, in.b, false, compare);
+			if (in.a < in.end_a && compare(in.a, in.b) == 0) {
+				memcpy(in.out, in.a, width);
+				in.out += width;
+				in.a += width;
+			}
+		}
+	} else while (in.a < in.end_a && in.b < in.end_b) {
+		int order = compare(in.a, in.b);
+		memcpy(in.out, in.a, width);
+		in.out += (order == 0) * width;
+		in.a += (order <= 0) * width;
+		in.b += (order >= 0) * width;
+	}
+	return sorted_finish(out, &in, false, false, width);
+}
+
+usize (sorted_difference)(u0 *out, const u0 *a, const u0 *b, usize width, Comparison compare)
+{
+	const MemSlice *as = a, *bs = b;
+	SortedInputs in = sorted_inputs(out, as, bs, as->len, width);
+	if (bs->len / SEARCH_GALLOP_RATIO > as->len) {
+		for (; in.a < in.end_a && in.b < in.end_b; in.a += width) {
+			in.b += width * gallop(in.b, (in.end_b - in.b) / width, width, in.a, false, compare);
+			bool found = in.b < in.end_b && compare(in.a, in.b) == 0;
+			memcpy(in.out, in.a, width);
+			in.out += !found * width;
+			in.b += found * width;
+		}
+	} else if (as->len / SEARCH_GALLOP_RATIO > bs->len) {
+		for (; in.a < in.end_a && in.b < in.end_b; in.b += width) {
+			usize bytes = width * gallop(in.a, (in.end_a - in.a) / width, width, in.b, false, compare);
+			memcpy(in.out, in.a, bytes);
+			in.out += bytes;
+			in.a += bytes;
+			if (in.a < in.end_a && compare(in.a, in.b) == 0)
+				in.a += width;
+		}
+	} else while (in.a < in.end_a && in.b < in.end_b) {
+		int order = compare(in.a, in.b);
+		memcpy(in.out, in.a, width);
+		in.out += (order < 0) * width;
+		in.a += (order <= 0) * width;
+		in.b += (order >= 0) * width;
+	}
+	return sorted_finish(out, &in, true, false, width);
+}
+
+usize dedup(u0 *self, usize width, Comparison compare)
+{
+	MemSlice *xs = self;
+	if (xs->len == 0) return 0;
+	umin *kept = xs->value;  // The last element kept.
+	for (usize i = 1; i < xs->len; ++i) {
+		const umin *x = xs->value + i * width;
+		memmove(kept + width, x, width);
+		kept += (compare(kept, x) != 0) * width;
+	}
+	xs->len = (kept - xs->value) / width + 1;
+	return xs->len;
+}
+
+#endif
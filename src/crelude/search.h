@@ -0,0 +1,257 @@
+//! @file search.h
+//! Binary search and set operations on sorted arrays, done by merging,
+//! instead of by building (and probing) a map.  Both inputs must be
+//! sorted by the same order, and the outputs are sorted by it too.
+//! Where one input is much longer than the other, the shorter one is
+//! looked up in the longer one by galloping (exponential search)
+//! instead, so the cost follows the shorter length.
+//! e.g.
+//! ```c
+//! #define BY_VALUE(A, B) (*(A) < *(B))
+//! DEFINE_SEARCH(ids, u64, BY_VALUE)
+//! usize n = ids_intersect(out, a.value, a.len, b.value, b.len);
+//! ```
+//! or, for slices of any type, with a comparison function:
+//! ```c
+//! arrayof(Player) both = AMAKE(Player, 0);
+//! SORTED_INTERSECT(both, team_a, team_b, compare_players);
+//! usize i = LOWER_BOUND(both, key, compare_players);
+//! ```
+
+#pragma once
+#include "common.h"
+#include "sort.h"
+
+/// A merge gallops, once one input gives this many elements in a row.
+#define SEARCH_GALLOP_AFTER 7
+/// Intersections and differences gallop, once one input is this
+/// many times longer than the other.
+#define SEARCH_GALLOP_RATIO 16
+
+/// Indices `[from, upto)` of a part of an array.
+record(Range) {
+	usize from, upto;
+};
+
+/// Define, for elements of type `T` sorted by `LESS(a, b)` (a macro
+/// on pointers to two elements, as for `DEFINE_SORT`):
+///  - `usize NAME_lower_bound(const T *xs, usize len, T key)`, the index
+///    of the first element not before `key` (or `len`).
+///  - `NAME_upper_bound`, likewise the first element after `key`.
+///  - `Range NAME_equal_range`, of the elements equivalent to `key`.
+///  - `usize NAME_merge(T *out, const T *a, usize na, const T *b, usize nb)`,
+///    merging both into `out` (stably, taking from `a` first).
+///  - `NAME_union`, `NAME_intersect` and `NAME_difference` (`a` without `b`),
+///    with the same arguments.  Equivalent elements are paired up one
+///    to one, and the elements written are those of `a` where paired.
+///  - `usize NAME_dedup(T *xs, usize len)`, keeping the first of every
+///    run of equivalent elements.
+/// Each returns the number of elements written, and `out` needs room for
+/// `na + nb` elements (`min(na, nb)` for an intersection, `na` for a
+/// difference).  The inner loops are branchless, but for galloping.
+#define DEFINE_SEARCH(NAME, T, LESS) \
+	/* Index of the first element after (or not before) `key`. */ \
+	__attribute__((unused, always_inline)) \
+	static inline usize NAME##_bound_(const T *xs, usize len, const T *key, bool upper) \
+	{ \
+		if (len == 0) return 0; \
+		const T *base = xs; \
+		while (len > 1) { \
+			usize half = len / 2; \
+			bool right = upper ? !LESS(key, &base[half]) : LESS(&base[half], key); \
+			base = right ? base + half : base; \
+			len -= half; \
+		} \
+		return (base - xs) + (upper ? !LESS(key, base) : LESS(base, key)); \
+	} \
+	/* Likewise, but searching outward from the start of `xs`. */ \
+	__attribute__((unused, always_inline)) \
+	static inline usize NAME##_gallop_(const T *xs, usize len, const T *key, bool upper) \
+	{ \
+		usize lo = 0, hi = 1; \
+		while (hi < len && (upper ? !LESS(key, &xs[hi]) : LESS(&xs[hi], key))) { \
+			lo = hi + 1; \
+			hi = 2 * hi + 1; \
+		} \
+		hi = hi < len ? hi : len; \
+		return lo + NAME##_bound_(xs + lo, hi - lo, key, upper); \
+	} \
+	__attribute__((unused)) \
+	static usize NAME##_lower_bound(const T *xs, usize len, T key) \
+	{ return NAME##_bound_(xs, len, &key, false); } \
+	__attribute__((unused)) \
+	static usize NAME##_upper_bound(const T *xs, usize len, T key) \
+	{ return NAME##_bound_(xs, len, &key, true); } \
+	__attribute__((unused)) \
+	static Range NAME##_equal_range(const T *xs, usize len, T key) \
+	{ \
+		usize from = NAME##_bound_(xs, len, &key, false); \
+		return (Range){ from, from + NAME##_gallop_(xs + from, len - from, &key, true) }; \
+	} \
+	__attribute__((unused)) \
+	static usize NAME##_merge(T *out, const T *a, usize na, const T *b, usize nb) \
+	{ \
+		T *o = out; \
+		const T *ea = a + na, *eb = b + nb; \
+		usize run_a = 0, run_b = 0; \
+		while (a < ea && b < eb) { \
+			if (__builtin_expect((run_a | run_b) >= SEARCH_GALLOP_AFTER, false)) { \
+				/* Copy the whole run at once. */ \
+				usize n; \
+				if (run_a > run_b) { \
+					n = NAME##_gallop_(a, ea - a, b, true); \
+					memcpy(o, a, n * sizeof(T)); a += n; \
+				} else { \
+					n = NAME##_gallop_(b, eb - b, a, false); \
+					memcpy(o, b, n * sizeof(T)); b += n; \
+				} \
+				o += n; \
+				run_a = run_b = 0; \
+				continue; \
+			} \
+			bool take_b = LESS(b, a); \
+			*o++ = take_b ? *b : *a; \
+			a += !take_b; b += take_b; \
+			run_a = (run_a + 1) & -(usize)!take_b; \
+			run_b = (run_b + 1) & -(usize)take_b; \
+		} \
+		memcpy(o, a, (ea - a) * sizeof(T)); o += ea - a; \
+		memcpy(o, b, (eb - b) * sizeof(T)); o += eb - b; \
+		return o - out; \
+	} \
+	__attribute__((unused)) \
+	static usize NAME##_union(T *out, const T *a, usize na, const T *b, usize nb) \
+	{ \
+		T *o = out; \
+		const T *ea = a + na, *eb = b + nb; \
+		while (a < ea && b < eb) { \
+			bool lt = LESS(a, b), gt = LESS(b, a); \
+			*o++ = gt ? *b : *a; \
+			a += !gt; b += !lt; \
+		} \
+		memcpy(o, a, (ea - a) * sizeof(T)); o += ea - a; \
+		memcpy(o, b, (eb - b) * sizeof(T)); o += eb - b; \
+		return o - out; \
+	} \
+	__attribute__((unused)) \
+	static usize NAME##_intersect(T *out, const T *a, usize na, const T *b, usize nb) \
+	{ \
+		T *o = out; \
+		const T *ea = a + na, *eb = b + nb; \
+		if (nb / SEARCH_GALLOP_RATIO > na) { \
+			for (; a < ea && b < eb; ++a) { \
+				b += NAME##_gallop_(b, eb - b, a, false); \
+				bool found = b < eb && !LESS(a, b); \
+				*o = *a; o += found; b += found; \
+			} \
+		} else if (na / SEARCH_GALLOP_RATIO > nb) { \
+			for (; a < ea && b < eb; ++b) { \
+				a += NAME##_gallop_(a, ea - a, b, false); \
+				if (a < ea && !LESS(b, a)) *o++ = *a++; \
+			} \
+		} else while (a < ea && b < eb) { \
+			bool lt = LESS(a, b), gt = LESS(b, a); \
+			*o = *a; o += !lt & !gt; \
+			a += !gt; b += !lt; \
+		} \
+		return o - out; \
+	} \
+	__attribute__((unused)) \
+	static usize NAME##_difference(T *out, const T *a, usize na, const T *b, usize nb) \
+	{ \
+		T *o = out; \
+		const T *ea = a + na, *eb = b + nb; \
+		if (nb / SEARCH_GALLOP_RATIO > na) { \
+			for (; a < ea && b < eb; ++a) { \
+				b += NAME##_gallop_(b, eb - b, a, false); \
+				bool found = b < eb && !LESS(a, b); \
+				*o = *a; o += !found; b += found; \
+			} \
+		} else if (na / SEARCH_GALLOP_RATIO > nb) { \
+			for (; a < ea && b < eb; ++b) { \
+				usize n = NAME##_gallop_(a, ea - a, b, false); \
+				memcpy(o, a, n * sizeof(T)); o += n; a += n; \
+				a += a < ea && !LESS(b, a); \
+			} \
+		} else while (a < ea && b < eb) { \
+			bool lt = LESS(a, b), gt = LESS(b, a); \
+			*o = *a; o += lt; \
+			a += !gt; b += !lt; \
+		} \
+		memcpy(o, a, (ea - a) * sizeof(T)); o += ea - a; \
+		return o - out; \
+	} \
+	__attribute__((unused)) \
+	static usize NAME##_dedup(T *xs, usize len) \
+	{ \
+		if (len == 0) return 0; \
+		usize kept = 1; \
+		for (usize i = 1; i < len; ++i) { \
+			T x = xs[i]; \
+			xs[kept] = x; \
+			kept += LESS(&xs[kept - 1], &x); \
+		} \
+		return kept; \
+	}
+
+/// Index of the first element of a sorted array or slice, of elements
+/// each `width` bytes, which does not go before `*key` (or its length).
+extern usize lower_bound(const u0 *self, usize width, const u0 *key, Comparison);
+/// Index of the first element which goes after `*key` (or the length).
+extern usize upper_bound(const u0 *self, usize width, const u0 *key, Comparison);
+/// Indices of the elements which compare equal to `*key`.
+extern Range equal_range(const u0 *self, usize width, const u0 *key, Comparison);
+
+/// Merge the sorted arrays or slices `a` and `b` (stably, taking from `a`
+/// first), appending to the dynamic array `out`, as for `DEFINE_SEARCH`.
+/// @returns The number of elements appended.
+extern usize sorted_merge(u0 *out, const u0 *a, const u0 *b, usize width, Comparison);
+/// Append the union of `a` and `b`, as for `DEFINE_SEARCH`.
+extern usize sorted_union(u0 *out, const u0 *a, const u0 *b, usize width, Comparison);
+/// Append the intersection of `a` and `b`, as for `DEFINE_SEARCH`.
+extern usize sorted_intersect(u0 *out, const u0 *a, const u0 *b, usize width, Comparison);
+/// Append the elements of `a` which are not in `b`, as for `DEFINE_SEARCH`.
+extern usize sorted_difference(u0 *out, const u0 *a, const u0 *b, usize width, Comparison);
+/// Remove all but the first of every run of equal elements, in place.
+/// @returns The new length.
+extern usize dedup(u0 *self, usize width, Comparison);
+
+#ifdef CRELUDE_PROFILE
+	#define sorted_merge(...)      PROFILE_CALL(sorted_merge, __VA_ARGS__)
+	#define sorted_union(...)      PROFILE_CALL(sorted_union, __VA_ARGS__)
+	#define sorted_intersect(...)  PROFILE_CALL(sorted_intersect, __VA_ARGS__)
+	#define sorted_difference(...) PROFILE_CALL(sorted_difference, __VA_ARGS__)
+#endif
+
+#define LOWER_BOUND(SELF, KEY, CMPR) __extension__\
+	({ __auto_type _self = (SELF); \
+	   typeof(*_self.value) _key = (KEY); \
+	   lower_bound(&_self, sizeof(_key), &_key, (CMPR)); })
+
+#define UPPER_BOUND(SELF, KEY, CMPR) __extension__\
+	({ __auto_type _self = (SELF); \
+	   typeof(*_self.value) _key = (KEY); \
+	   upper_bound(&_self, sizeof(_key), &_key, (CMPR)); })
+
+#define EQUAL_RANGE(SELF, KEY, CMPR) __extension__\
+	({ __auto_type _self = (SELF); \
+	   typeof(*_self.value) _key = (KEY); \
+	   equal_range(&_self, sizeof(_key), &_key, (CMPR)); })
+
+#define SORTED_OP_(OP, OUT, A, B, CMPR) __extension__\
+	({ __auto_type _out = &(OUT); \
+	   __auto_type _a = (A); \
+	   __auto_type _b = (B); \
+	   _Static_assert(sizeof(*_a.value) == sizeof(*_out->value) \
+	               && sizeof(*_b.value) == sizeof(*_out->value), \
+	       "Sorted sets must have elements of the same type."); \
+	   OP(_out, &_a, &_b, sizeof(*_out->value), (CMPR)); })
+
+#define SORTED_MERGE(OUT, A, B, CMPR)      SORTED_OP_(sorted_merge, OUT, A, B, CMPR)
+#define SORTED_UNION(OUT, A, B, CMPR)      SORTED_OP_(sorted_union, OUT, A, B, CMPR)
+#define SORTED_INTERSECT(OUT, A, B, CMPR)  SORTED_OP_(sorted_intersect, OUT, A, B, CMPR)
+#define SORTED_DIFFERENCE(OUT, A, B, CMPR) SORTED_OP_(sorted_difference, OUT, A, B, CMPR)
+
+#define DEDUP(SELF, CMPR) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   dedup(_self, sizeof(*_self->value), (CMPR)); })
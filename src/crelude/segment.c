@@ -0,0 +1,62 @@
+#include "segment.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+usize (segmented_reserve)(u0 *self, usize count, usize width)
+{
+	MemSegmented *arr = self;
+	usize old_cap = arr->cap;
+	for (usize k = 0; arr->cap < arr->len + count; ++k) {
+		if (k >= SEGMENT_MAX)
+			PANIC("Cannot hold %zu elements.", arr->len + count);
+		unless (arr->segments[k] == nil) continue;
+		arr->segments[k] = eallocate(arr->alloc, SEGMENT_SIZE(k), width);
+		arr->cap += SEGMENT_SIZE(k);
+	}
+	return arr->cap - old_cap;
+}
+
+u0 *(segmented_push)(u0 *self, const u0 *elem, usize width)
+{
+	MemSegmented *arr = self;
+	usize offset;
+	usize k = segment_of(arr->len, &offset);
+	if (arr->segments[k] == nil)
+		segmented_reserve(arr, 1, width);
+	umin *ptr = arr->segments[k] + offset * width;
+	memcpy(ptr, elem, width);
+	++arr->len;
+	return ptr;
+}
+
+u0 *segmented_pop(u0 *self, usize width)
+{
+	MemSegmented *arr = self;
+	assert(arr->len > 0);
+	usize offset;
+	usize k = segment_of(--arr->len, &offset);
+	return arr->segments[k] + offset * width;
+}
+
+MemSlice segmented_view(const u0 *self, usize k)
+{
+	const MemSegmented *arr = self;
+	if (k >= SEGMENT_MAX) return SEMPTY(MemSlice);
+	usize start = SEGMENT_SIZE(k) - SEGMENT_BASE;  //< sum of the earlier ones.
+	if (start >= arr->len) return SEMPTY(MemSlice);
+	usize len = min(SEGMENT_SIZE(k), arr->len - start);
+	return VIEW(MemSlice, arr->segments[k], 0, len);
+}
+
+u0 segmented_free(u0 *self, usize width)
+{
+	MemSegmented *arr = self;
+	for (usize k = 0; k < SEGMENT_MAX && arr->segments[k] != nil; ++k) {
+		deallocate(arr->alloc, arr->segments[k], SEGMENT_SIZE(k) * width);
+		arr->segments[k] = nil;
+	}
+	arr->len = arr->cap = 0;
+}
+
+#endif
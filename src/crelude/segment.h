@@ -0,0 +1,121 @@
+//! @file segment.h
+//! Segmented arrays, which grow by adding segments (each twice
+//! the size of the last) instead of reallocating.  Elements never
+//! move, so pointers to them stay valid for as long as the array lives,
+//! and growing never copies.  Indexing is still O(1), the segment
+//! being found from the highest set bit of the index.
+//! e.g.
+//! ```c
+//! segmentedof(Node) nodes = { 0 };  //< or `{ .alloc = &arena->allocator }`.
+//! Node *root = SEG_PUSH(nodes, (Node){ 0 });
+//! for (usize i = 0; i < 1000; ++i) SEG_PUSH(nodes, (Node){ .parent = root });
+//! SEG_FOR_EACH(node, nodes) assert(node.parent == root || it.index == 0);
+//! SEG_FREE(nodes);
+//! ```
+
+#pragma once
+#include "common.h"
+
+/// The first segment holds `1 << SEGMENT_BASE_BITS` elements.
+#define SEGMENT_BASE_BITS 4
+#define SEGMENT_BASE ((usize)1 << SEGMENT_BASE_BITS)
+/// Enough segments for any number of elements that fits in memory.
+#define SEGMENT_MAX (sizeof(usize) * CHAR_BIT - SEGMENT_BASE_BITS)
+/// Number of elements in the `K`th segment.
+#define SEGMENT_SIZE(K) (SEGMENT_BASE << (K))
+
+#define segmentedof(T) struct { \
+	T *segments[SEGMENT_MAX]; /* nil once past the allocated ones. */ \
+	usize len;  \
+	usize cap;  /* elements in all allocated segments. */ \
+	Allocator *alloc; /* nil means the default allocator. */ \
+}
+#define newsegmented(NT, T) typedef segmentedof(T) NT
+
+/// Segmented array with pointers to void.
+newsegmented(GenericSegmented, u0);
+/// Segmented array with pointers to smallest addressable units of memory.
+newsegmented(MemSegmented, umin);
+
+/// Which segment the element at `index` is in, and where in it.
+static inline usize segment_of(usize index, usize *offset)
+{
+	usize i = index + SEGMENT_BASE;
+	usize top = sizeof(usize) * CHAR_BIT - 1 - __builtin_clzl(i);
+	*offset = i - ((usize)1 << top);
+	return top - SEGMENT_BASE_BITS;
+}
+
+/// Pointer to the element at `index`, or `nil` if out of bounds.
+static inline u0 *segmented_get(const u0 *self, usize index, usize width)
+{
+	const MemSegmented *arr = self;
+	if (index >= arr->len) return nil;
+	usize offset;
+	usize k = segment_of(index, &offset);
+	return arr->segments[k] + offset * width;
+}
+
+/// Allocate segments until there is room for `count` more elements.
+/// @returns By how many elements the capacity grew.
+extern usize segmented_reserve(u0 *self, usize count, usize width);
+/// Copy an element onto the end.
+/// @returns Pointer to the element, which stays where it is.
+extern u0 *segmented_push(u0 *self, const u0 *elem, usize width);
+/// Remove the last element, which must exist.  Its memory is kept.
+/// @returns Pointer to the element, valid until the next push.
+extern u0 *segmented_pop(u0 *self, usize width);
+/// The elements in the `k`th segment, as one contiguous slice
+/// (of `len` elements, not bytes), which is empty past the last one.
+extern MemSlice segmented_view(const u0 *self, usize k);
+/// Free all segments, and empty the array.
+extern u0 segmented_free(u0 *self, usize width);
+
+#ifdef CRELUDE_PROFILE
+	#define segmented_reserve(...) PROFILE_CALL(segmented_reserve, __VA_ARGS__)
+	#define segmented_push(...)    PROFILE_CALL(segmented_push, __VA_ARGS__)
+#endif
+
+#define SEG_PUSH(SELF, ELEM) __extension__\
+	({ __auto_type              _self = &(SELF); \
+	   typeof(**_self->segments) _elem = (ELEM); \
+	   (typeof(*_self->segments))segmented_push(_self, &_elem, sizeof(_elem)); })
+
+#define SEG_POP(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   (typeof(*_self->segments))segmented_pop(_self, \
+	       sizeof(**_self->segments)); })
+
+#define SEG_GET(SELF, INDEX) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   (typeof(*_self->segments))segmented_get(_self, (INDEX), \
+	       sizeof(**_self->segments)); })
+
+#define SEG_RESERVE(SELF, COUNT) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   segmented_reserve(_self, (COUNT), sizeof(**_self->segments)); })
+
+#define SEG_FREE(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   segmented_free(_self, sizeof(**_self->segments)); })
+
+/// For-each loop across a segmented array, a segment at a time.
+/// Like `FOR_EACH`, it creates an `it` variable, that holds:
+///  - it.index   (index in the array);
+///  - it.ptr     (pointer to the current item);
+///  - it.segment (which segment the item is in).
+/// `break` and `continue` work as in any loop.
+#define SEG_FOR_EACH(ELEM, SELF) \
+	for (struct { typeof(*(SELF).segments) ptr; \
+	              usize index, segment, offset, len; \
+	              bool once; \
+	            } it = { .segment = -1, .once = true }; it.once; it.once = false) \
+		/* Next segment, only once the last one ran to its end. */ \
+		for (; it.offset == it.len && it.index < (SELF).len \
+		       && (++it.segment, it.offset = 0, \
+		           it.len = min(SEGMENT_SIZE(it.segment), (SELF).len - it.index), \
+		           true); ) \
+			for (typeof(**(SELF).segments) ELEM; it.offset < it.len \
+			     && (it.ptr = (SELF).segments[it.segment] + it.offset, \
+			         ELEM = *it.ptr, true); \
+			     ++it.offset, ++it.index)
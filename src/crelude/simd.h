@@ -0,0 +1,434 @@
+//! @file simd.h
+//! Vector instruction sets, selected at compile time by what the
+//! compiler targets (e.g. `-mavx2`, or `-march=native`), and a thin
+//! layer over them that the memory primitives are written against.
+//! Without any of AVX2, SSE2 or NEON, `SIMD_WIDTH` is zero and
+//! plain word-at-a-time code is used instead.
+//!
+//! Each vectorised primitive has a `_scalar` counterpart here,
+//! being the reference implementation it is checked against.
+
+#pragma once
+#include "common.h"
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define SIMD_SSSE3 1
+	#define SIMD_AVX2 1
+	#define SIMD_NAME "AVX2"
+	#define SIMD_WIDTH 32
+	typedef __m256i vec;
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+	#ifdef __SSSE3__
+		#include <tmmintrin.h>
+		#define SIMD_SSSE3 1
+	#endif
+	#define SIMD_SSE2 1
+	#define SIMD_NAME "SSE2"
+	#define SIMD_WIDTH 16
+	typedef __m128i vec;
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+	#define SIMD_NEON 1
+	#define SIMD_NAME "NEON"
+	#define SIMD_WIDTH 16
+	typedef uint8x16_t vec;
+#else
+	#define SIMD_NAME "none"
+	#define SIMD_WIDTH 0
+#endif
+
+#if SIMD_WIDTH > 0
+/// Unaligned load of a vector.
+static inline vec vec_load(const u0 *ptr)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_loadu_si256((const __m256i *)ptr);
+#elif defined(SIMD_SSE2)
+	return _mm_loadu_si128((const __m128i *)ptr);
+#elif defined(SIMD_NEON)
+	return vld1q_u8(ptr);
+#endif
+}
+
+static inline vec vec_zero(void)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_setzero_si256();
+#elif defined(SIMD_SSE2)
+	return _mm_setzero_si128();
+#elif defined(SIMD_NEON)
+	return vdupq_n_u8(0);
+#endif
+}
+
+/// Unaligned store of a vector.
+static inline u0 vec_store(u0 *ptr, vec v)
+{
+#if defined(SIMD_AVX2)
+	_mm256_storeu_si256((__m256i *)ptr, v);
+#elif defined(SIMD_SSE2)
+	_mm_storeu_si128((__m128i *)ptr, v);
+#elif defined(SIMD_NEON)
+	vst1q_u8(ptr, v);
+#endif
+}
+
+static inline vec vec_or(vec a, vec b)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_or_si256(a, b);
+#elif defined(SIMD_SSE2)
+	return _mm_or_si128(a, b);
+#elif defined(SIMD_NEON)
+	return vorrq_u8(a, b);
+#endif
+}
+
+static inline vec vec_and(vec a, vec b)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_and_si256(a, b);
+#elif defined(SIMD_SSE2)
+	return _mm_and_si128(a, b);
+#elif defined(SIMD_NEON)
+	return vandq_u8(a, b);
+#endif
+}
+
+static inline vec vec_xor(vec a, vec b)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_xor_si256(a, b);
+#elif defined(SIMD_SSE2)
+	return _mm_xor_si128(a, b);
+#elif defined(SIMD_NEON)
+	return veorq_u8(a, b);
+#endif
+}
+
+/// The bits of `a` which are not set in `b`, i.e. `a & ~b`.
+static inline vec vec_andnot(vec a, vec b)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_andnot_si256(b, a);
+#elif defined(SIMD_SSE2)
+	return _mm_andnot_si128(b, a);
+#elif defined(SIMD_NEON)
+	return vbicq_u8(a, b);
+#endif
+}
+
+/// Reverse the order of the `width`-byte lanes in a vector,
+/// for `width` one of 1, 2, 4 or 8 (known at compile time).
+static inline vec vec_reverse(vec v, usize width)
+{
+#if defined(SIMD_AVX2)
+	switch (width) {
+	case 1:
+		v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+			15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+			15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+		return _mm256_permute4x64_epi64(v, 0x4E);
+	case 2:
+		v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+			14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+			14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1));
+		return _mm256_permute4x64_epi64(v, 0x4E);
+	case 4:
+		return _mm256_permutevar8x32_epi32(v,
+			_mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+	default:
+		return _mm256_permute4x64_epi64(v, 0x1B);
+	}
+#elif defined(SIMD_SSE2)
+	switch (width) {
+	case 1:
+	#ifdef SIMD_SSSE3
+		return _mm_shuffle_epi8(v, _mm_setr_epi8(
+			15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+	#else
+		v = vec_reverse(v, 2);  // then swap the bytes of each pair.
+		return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	#endif
+	case 2:
+		v = _mm_shufflelo_epi16(v, 0x1B);
+		v = _mm_shufflehi_epi16(v, 0x1B);
+		return _mm_shuffle_epi32(v, 0x4E);
+	case 4:
+		return _mm_shuffle_epi32(v, 0x1B);
+	default:
+		return _mm_shuffle_epi32(v, 0x4E);
+	}
+#elif defined(SIMD_NEON)
+	switch (width) {
+	case 1:
+		v = vrev64q_u8(v);
+		break;
+	case 2:
+		v = vreinterpretq_u8_u16(vrev64q_u16(vreinterpretq_u16_u8(v)));
+		break;
+	case 4:
+		v = vreinterpretq_u8_u32(vrev64q_u32(vreinterpretq_u32_u8(v)));
+		break;
+	}
+	return vextq_u8(v, v, 8);  // swap the two halves.
+#endif
+}
+
+/// Reverse the bytes within each `width`-byte lane of a vector,
+/// for `width` one of 2, 4, 8 or 16 (known at compile time).
+static inline vec vec_byteswap(vec v, usize width)
+{
+#if defined(SIMD_AVX2)
+	switch (width) {
+	case 2: return _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+	case 4: return _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+	case 8: return _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+	default: return _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+	}
+#elif defined(SIMD_SSSE3)
+	switch (width) {
+	case 2: return _mm_shuffle_epi8(v, _mm_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+	case 4: return _mm_shuffle_epi8(v, _mm_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+	case 8: return _mm_shuffle_epi8(v, _mm_setr_epi8(
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+	default: return vec_reverse(v, 1);
+	}
+#elif defined(SIMD_SSE2)
+	// Swap the bytes of each pair, then shuffle the pairs.
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	switch (width) {
+	case 2: return v;
+	case 4:
+		v = _mm_shufflelo_epi16(v, 0xB1);
+		return _mm_shufflehi_epi16(v, 0xB1);
+	case 8:
+		v = _mm_shufflelo_epi16(v, 0x1B);
+		return _mm_shufflehi_epi16(v, 0x1B);
+	default: return vec_reverse(v, 2);
+	}
+#elif defined(SIMD_NEON)
+	switch (width) {
+	case 2: return vrev16q_u8(v);
+	case 4: return vrev32q_u8(v);
+	case 8: return vrev64q_u8(v);
+	default: return vec_reverse(v, 1);
+	}
+#endif
+}
+
+/// Whether every bit of the vector is zero.
+static inline bool vec_is_zero(vec v)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_testz_si256(v, v);
+#elif defined(SIMD_SSE2)
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xFFFF;
+#elif defined(SIMD_NEON) && defined(__aarch64__)
+	return vmaxvq_u8(v) == 0;
+#elif defined(SIMD_NEON)
+	uint64x2_t words = vreinterpretq_u64_u8(v);
+	return (vgetq_lane_u64(words, 0) | vgetq_lane_u64(words, 1)) == 0;
+#endif
+}
+
+/// Number of set bits in each byte of a vector.
+static inline vec vec_popcount8(vec v)
+{
+#if defined(SIMD_AVX2)
+	const __m256i table = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	__m256i low = _mm256_and_si256(v, nibble);
+	__m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+	return _mm256_add_epi8(_mm256_shuffle_epi8(table, low),
+	                       _mm256_shuffle_epi8(table, high));
+#elif defined(SIMD_SSSE3)
+	// Look up the count of each nibble.
+	const __m128i table = _mm_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	__m128i low = _mm_and_si128(v, nibble);
+	__m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+	return _mm_add_epi8(_mm_shuffle_epi8(table, low),
+	                    _mm_shuffle_epi8(table, high));
+#elif defined(SIMD_SSE2)
+	// Add adjacent pairs of bits, then of those, and so on, bytewise.
+	v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x55)));
+	v = _mm_add_epi8(_mm_and_si128(v, _mm_set1_epi8(0x33)),
+	                 _mm_and_si128(_mm_srli_epi16(v, 2), _mm_set1_epi8(0x33)));
+	return _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi16(v, 4)), _mm_set1_epi8(0x0F));
+#elif defined(SIMD_NEON)
+	return vcntq_u8(v);
+#endif
+}
+
+/// Bytewise (wrapping) addition.
+static inline vec vec_add8(vec a, vec b)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_add_epi8(a, b);
+#elif defined(SIMD_SSE2)
+	return _mm_add_epi8(a, b);
+#elif defined(SIMD_NEON)
+	return vaddq_u8(a, b);
+#endif
+}
+
+/// Addition of the 64-bit lanes.
+static inline vec vec_add64(vec a, vec b)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_add_epi64(a, b);
+#elif defined(SIMD_SSE2)
+	return _mm_add_epi64(a, b);
+#elif defined(SIMD_NEON)
+	return vreinterpretq_u8_u64(vaddq_u64(vreinterpretq_u64_u8(a), vreinterpretq_u64_u8(b)));
+#endif
+}
+
+/// Each 64-bit lane being the sum of its eight bytes.
+static inline vec vec_sum_bytes64(vec v)
+{
+#if defined(SIMD_AVX2)
+	return _mm256_sad_epu8(v, vec_zero());
+#elif defined(SIMD_SSE2)
+	return _mm_sad_epu8(v, vec_zero());
+#elif defined(SIMD_NEON)
+	return vreinterpretq_u8_u64(vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(v))));
+#endif
+}
+#endif
+
+/// Bit `i` is set where byte `i` of the 16 at `ptr` equals `tag`.
+static inline u32 bytes16_match_scalar(const u0 *ptr, u8 tag)
+{
+	const u8 *bytes = ptr;
+	u32 mask = 0;
+	for (usize i = 0; i < 16; ++i) mask |= (u32)(bytes[i] == tag) << i;
+	return mask;
+}
+
+/// Bit `i` is set where byte `i` of the 16 at `ptr` has its top bit set.
+static inline u32 bytes16_high_scalar(const u0 *ptr)
+{
+	const u8 *bytes = ptr;
+	u32 mask = 0;
+	for (usize i = 0; i < 16; ++i) mask |= (u32)(bytes[i] >> 7) << i;
+	return mask;
+}
+
+#if defined(SIMD_NEON) && defined(__aarch64__)
+/// Bit mask of the top bits of the bytes of `v`, as SSE2's `movemask`.
+static inline u32 neon_movemask(uint8x16_t v)
+{
+	static const u8 weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t high = vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(v), 7));
+	uint8x16_t bits = vandq_u8(high, vld1q_u8(weights));
+	return vaddv_u8(vget_low_u8(bits)) | (u32)vaddv_u8(vget_high_u8(bits)) << 8;
+}
+#endif
+
+/// Groups of 16 bytes are always matched 16 at a time (with SSE2 even
+/// when AVX2 is there), e.g. for the control bytes of a `tableof`.
+static inline u32 bytes16_match(const u0 *ptr, u8 tag)
+{
+#if defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((const __m128i *)ptr);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)tag)));
+#elif defined(SIMD_NEON) && defined(__aarch64__)
+	return neon_movemask(vceqq_u8(vld1q_u8(ptr), vdupq_n_u8(tag)));
+#else
+	return bytes16_match_scalar(ptr, tag);
+#endif
+}
+
+static inline u32 bytes16_high(const u0 *ptr)
+{
+#if defined(__SSE2__)
+	return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ptr));
+#elif defined(SIMD_NEON) && defined(__aarch64__)
+	return neon_movemask(vld1q_u8(ptr));
+#else
+	return bytes16_high_scalar(ptr);
+#endif
+}
+
+/// Number of set bits in a word.  The builtin is only used where it is
+/// an instruction, as otherwise it becomes a call into libgcc.
+static inline usize popcount_word(u64 word)
+{
+#if defined(__POPCNT__) || defined(__aarch64__)
+	return __builtin_popcountll(word);
+#else
+	word -= (word >> 1) & 0x5555555555555555ull;
+	word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (word * 0x0101010101010101ull) >> 56;
+#endif
+}
+
+/// Number of set bits in `len` words.
+static inline usize popcount_scalar(const u64 *words, usize len)
+{
+	usize count = 0;
+	for (usize i = 0; i < len; ++i)
+		count += __builtin_popcountll(words[i]);
+	return count;
+}
+
+static inline u0 zero_scalar(u0 *blk, usize width)
+{
+	umin *bytes = blk;
+	until (width-- == 0)
+		*bytes++ = 0;
+}
+
+static inline bool is_zeroed_scalar(const u0 *ptr, usize width)
+{
+	const umin *xs = ptr;
+	until (width-- == 0) unless (*xs++ == 0) return false;
+	return true;
+}
+
+static inline u0 memswap_scalar(umin *a, umin *b, usize bytes)
+{
+	for (usize i = 0; i < bytes; ++i) {
+		umin tmp = a[i];
+		a[i] = b[i];
+		b[i] = tmp;
+	}
+}
+
+/// Reverse the elements of an array of `len` elements, each `width` bytes.
+static inline u0 reverse_scalar(u0 *ptr, usize len, usize width)
+{
+	umin *elems = ptr;
+	for (usize i = 0, j = len; i + 1 < j--; ++i)
+		memswap_scalar(elems + i * width, elems + j * width, width);
+}
+
+/// Reverse the bytes of each of `len` elements, each `width` bytes.
+static inline u0 byteswap_scalar(u0 *dst, const u0 *src, usize len, usize width)
+{
+	umin *out = dst;
+	const umin *in = src;
+	for (usize i = 0; i < len; ++i, in += width, out += width) {
+		umin tmp[width];
+		for (usize j = 0; j < width; ++j) tmp[j] = in[width - 1 - j];
+		memcpy(out, tmp, width);
+	}
+}
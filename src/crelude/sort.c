@@ -0,0 +1,234 @@
+#include "sort.h"
+#include "thread.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+/// Below this many elements, comparison sorting is quicker.
+#define RADIX_SORT_CUTOFF 256
+
+/// For every unsigned type `U`, a key (of the bits of a number) which
+/// orders as an unsigned integer in the same way as the number does,
+/// and an LSD radix sort of such numbers.
+#define DEFINE_RADIX_SORT(U) \
+	static inline U radix_key_##U(U x, RadixKey key) \
+	{ \
+		const U sign = (U)1 << (sizeof(U) * CHAR_BIT - 1); \
+		switch (key) { \
+		case RADIX_SIGNED: return x ^ sign; \
+		/* Negative floats order backwards, as sign and magnitude. */ \
+		case RADIX_FLOAT: return (x & sign) ? (U)~x : (U)(x ^ sign); \
+		default: return x; \
+		} \
+	} \
+	\
+	static inline bool radix_less_##U(RadixKey key, const U *a, const U *b) \
+	{ return radix_key_##U(*a, key) < radix_key_##U(*b, key); } \
+	\
+	static u0 radix_sort_##U(U *xs, usize len, RadixKey key) \
+	{ \
+		if (len < RADIX_SORT_CUTOFF) { \
+			SORT_BODY(U, xs, len, radix_less_##U, key); \
+			return UNIT; \
+		} \
+		/* Count the digits of every byte, in one pass. */ \
+		usize counts[sizeof(U)][256] = { 0 }; \
+		for (usize i = 0; i < len; ++i) { \
+			U k = radix_key_##U(xs[i], key); \
+			for (usize d = 0; d < sizeof(U); ++d) \
+				++counts[d][(k >> (8 * d)) & 0xFF]; \
+		} \
+		U *scratch = allocate(nil, len * sizeof(U)); \
+		if (scratch == nil) \
+			PANIC("Could not allocate %zu bytes.", len * sizeof(U)); \
+		U *src = xs, *dst = scratch; \
+		for (usize d = 0; d < sizeof(U); ++d) { \
+			usize *count = counts[d]; \
+			U first = radix_key_##U(src[0], key); \
+			if (count[(first >> (8 * d)) & 0xFF] == len) \
+				continue;  /* Every element has the same byte here. */ \
+			for (usize b = 0, offset = 0; b < 256; ++b) { \
+				usize c = count[b]; \
+				count[b] = offset; \
+				offset += c; \
+			} \
+			for (usize i = 0; i < len; ++i) { \
+				U x = src[i]; \
+				dst[count[(radix_key_##U(x, key) >> (8 * d)) & 0xFF]++] = x; \
+			} \
+			U *tmp = src; src = dst; dst = tmp; \
+		} \
+		if (src != xs) memcpy(xs, src, len * sizeof(U)); \
+		deallocate(nil, scratch, len * sizeof(U)); \
+	}
+
+DEFINE_RADIX_SORT(u8)
+DEFINE_RADIX_SORT(u16)
+DEFINE_RADIX_SORT(u32)
+DEFINE_RADIX_SORT(u64)
+
+u0 radix_sort(u0 *self, usize width, RadixKey key)
+{
+	MemSlice *xs = self;
+	switch (width) {
+	case 1: radix_sort_u8((u8 *)xs->value, xs->len, key); break;
+	case 2: radix_sort_u16((u16 *)xs->value, xs->len, key); break;
+	case 4: radix_sort_u32((u32 *)xs->value, xs->len, key); break;
+	case 8: radix_sort_u64((u64 *)xs->value, xs->len, key); break;
+	default: PANIC("Cannot radix sort elements of %zu bytes.", width);
+	}
+}
+
+/// Words which may alias anything, and need not be aligned,
+/// for moving elements of these sizes about as whole words.
+typedef u16  __attribute__((may_alias, aligned(1))) word16;
+typedef u32  __attribute__((may_alias, aligned(1))) word32;
+typedef u64  __attribute__((may_alias, aligned(1))) word64;
+typedef u128 __attribute__((may_alias, aligned(1))) word128;
+
+u0 sort_with(u0 *self, usize width, Comparison compare)
+{
+	MemSlice *xs = self;
+	switch (width) {
+	case 1:  SORT_BODY(u8, xs->value, xs->len, SORT_BY_COMPARE, compare); break;
+	case 2:  SORT_BODY(word16, (word16 *)xs->value, xs->len, SORT_BY_COMPARE, compare); break;
+	case 4:  SORT_BODY(word32, (word32 *)xs->value, xs->len, SORT_BY_COMPARE, compare); break;
+	case 8:  SORT_BODY(word64, (word64 *)xs->value, xs->len, SORT_BY_COMPARE, compare); break;
+	case 16: SORT_BODY(word128, (word128 *)xs->value, xs->len, SORT_BY_COMPARE, compare); break;
+	default: qsort(xs->value, xs->len, width, compare); break;
+	}
+}
+
+/// Below this many elements, sorting in parallel is not worth it.
+#define PSORT_CUTOFF (1 << 14)
+
+record(ParallelSort) {
+	umin *src, *dst;
+	usize len, width;
+	Comparison compare;
+	usize chunks;  ///< Number of sorted runs, in the current round.
+	usize run;     ///< Length of each run (but the last).
+	usize parts;   ///< Tasks per merge, in the current round.
+};
+
+static u0 sort_chunk(u0 *context, usize i)
+{
+	ParallelSort *ps = context;
+	usize from = i * ps->run, upto = min(from + ps->run, ps->len);
+	MemSlice chunk = VIEW(MemSlice, ps->src, from * ps->width, upto * ps->width);
+	chunk.len = upto - from;
+	sort_with(&chunk, ps->width, ps->compare);
+}
+
+/// How many of the first `k` merged elements come from `a`, where
+/// ties are taken from `a` first.
+static usize co_rank(usize k, const umin *a, usize na, const umin *b, usize nb,
+                     usize width, Comparison compare)
+{
+	usize lo = k > nb ? k - nb : 0, hi = min(k, na);
+	while (lo < hi) {
+		usize i = lo + (hi - lo) / 2, j = k - i;
+		if (compare(a + i * width, b + (j - 1) * width) <= 0)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	return lo;
+}
+
+/// Merge `a` and `b` into `out`, taking from `a` on ties.
+#define MERGE_KERNEL(T, OUT, A, NA, B, NB, COMPARE) do { \
+	T *_out = (T *)(OUT); \
+	const T *_a = (const T *)(A), *_b = (const T *)(B); \
+	const T *_ea = _a + (NA), *_eb = _b + (NB); \
+	while (_a < _ea && _b < _eb) \
+		*_out++ = (COMPARE)(_b, _a) < 0 ? *_b++ : *_a++; \
+	while (_a < _ea) *_out++ = *_a++; \
+	while (_b < _eb) *_out++ = *_b++; \
+} while (0)
+
+static u0 merge(umin *out, const umin *a, usize na, const umin *b, usize nb,
+                usize width, Comparison compare)
+{
+	switch (width) {
+	case 1:  MERGE_KERNEL(u8, out, a, na, b, nb, compare); break;
+	case 2:  MERGE_KERNEL(word16, out, a, na, b, nb, compare); break;
+	case 4:  MERGE_KERNEL(word32, out, a, na, b, nb, compare); break;
+	case 8:  MERGE_KERNEL(word64, out, a, na, b, nb, compare); break;
+	case 16: MERGE_KERNEL(word128, out, a, na, b, nb, compare); break;
+	default:
+		while (na > 0 && nb > 0) {
+			bool take_b = compare(b, a) < 0;
+			memcpy(out, take_b ? b : a, width);
+			if (take_b) b += width, --nb;
+			else        a += width, --na;
+			out += width;
+		}
+		memcpy(out, a, na * width);
+		memcpy(out + na * width, b, nb * width);
+	}
+}
+
+/// Merge a part of a pair of runs, being the part of the output
+/// between two co-ranks, such that parts of a merge are independent.
+static u0 merge_part(u0 *context, usize t)
+{
+	ParallelSort *ps = context;
+	usize pair = t / ps->parts, part = t % ps->parts;
+	usize w = ps->width;
+	usize start = 2 * pair * ps->run;
+	usize na = min(ps->run, ps->len - start);
+	usize nb = min(ps->run, ps->len - start - na);
+	const umin *a = ps->src + start * w, *b = a + na * w;
+
+	usize n = na + nb;
+	usize k0 = n * part / ps->parts, k1 = n * (part + 1) / ps->parts;
+	usize i0 = co_rank(k0, a, na, b, nb, w, ps->compare);
+	usize i1 = co_rank(k1, a, na, b, nb, w, ps->compare);
+	merge(ps->dst + (start + k0) * w,
+		a + i0 * w, i1 - i0,
+		b + (k0 - i0) * w, (k1 - i1) - (k0 - i0),
+		w, ps->compare);
+}
+
+u0 psort(u0 *self, usize width, Comparison compare, usize threads)
+{ psort_on(workers_default(), self, width, compare, threads); }
+
+u0 psort_on(WorkerPool *pool, u0 *self, usize width, Comparison compare, usize threads)
+{
+	MemSlice *xs = self;
+	if (threads == 0) threads = pool->count + 1;
+	threads = min(threads, xs->len / (PSORT_CUTOFF / 2));
+	if (threads <= 1) {
+		sort_with(xs, width, compare);
+		return UNIT;
+	}
+
+	usize bytes = xs->len * width;
+	umin *scratch = allocate(nil, bytes);
+	if (scratch == nil)
+		PANIC("Could not allocate %zu bytes.", bytes);
+
+	ParallelSort ps = {
+		.src = xs->value, .dst = scratch,
+		.len = xs->len, .width = width,
+		.compare = compare,
+		.chunks = threads,
+		.run = (xs->len + threads - 1) / threads
+	};
+	workers_run(pool, ps.chunks, sort_chunk, &ps);
+
+	while (ps.chunks > 1) {
+		usize pairs = (ps.chunks + 1) / 2;
+		ps.parts = max(threads / pairs, (usize)1);
+		workers_run(pool, pairs * ps.parts, merge_part, &ps);
+		umin *tmp = ps.src; ps.src = ps.dst; ps.dst = tmp;
+		ps.chunks = pairs;
+		ps.run *= 2;
+	}
+	if (ps.src != xs->value)
+		memcpy(xs->value, ps.src, bytes);
+	deallocate(nil, scratch, bytes);
+}
+
+#endif
@@ -0,0 +1,267 @@
+//! @file sort.h
+//! Type-specialised in-place sorting.  The sort is generated by macro
+//! for the element type at hand, with the comparison inlined into it,
+//! instead of going through `qsort` and a function pointer per compare.
+//! The algorithm is a pattern-defeating quicksort: median-of-three
+//! (or ninther) pivots, insertion sort for short ranges, detection of
+//! already sorted runs, and heap sort once partitions keep going bad,
+//! so it is never worse than O(n log n).  It is not stable.
+//! e.g.
+//! ```c
+//! #define BY_SCORE(A, B) ((A)->score < (B)->score)
+//! DEFINE_SORT(sort_players, Player, BY_SCORE)
+//! sort_players(players.value, players.len);
+//! ```
+//! `SORT` and `QSORT` (in common.h) are also built on this.
+//! For integer and float keys, `RADIX_SORT` is faster still.
+
+#pragma once
+#include "common.h"
+
+/// Ranges shorter than this are insertion sorted.
+#define SORT_INSERTION_CUTOFF 24
+/// Ranges longer than this take a pivot from a ninther.
+#define SORT_NINTHER_CUTOFF 128
+/// Sorted runs are only finished by insertion sort, if it
+/// takes no more than this many moves.
+#define SORT_PARTIAL_INSERTION_LIMIT 8
+
+/// `LESS` for `SORT_BODY`, from a `qsort`-style comparison function.
+#define SORT_BY_COMPARE(CMPR, A, B) ((CMPR)((A), (B)) < 0)
+/// `LESS` for `SORT_BODY`, from a macro `LT(A, B)` on pointers.
+#define SORT_BY_LESS(LT, A, B) LT(A, B)
+
+#define SORT_SWAP_(T, A, B) do { \
+	typeof(T) *_sa = (A), *_sb = (B); \
+	T _st = *_sa; *_sa = *_sb; *_sb = _st; \
+} while (0)
+
+/// Order `*A` and `*B`.
+#define SORT2_(T, A, B, LESS, CTX) do { \
+	typeof(T) *_s2a = (A), *_s2b = (B); \
+	if (LESS(CTX, _s2b, _s2a)) SORT_SWAP_(T, _s2a, _s2b); \
+} while (0)
+
+/// Order `*A`, `*B` and `*C`.
+#define SORT3_(T, A, B, C, LESS, CTX) do { \
+	typeof(T) *_s3a = (A), *_s3b = (B), *_s3c = (C); \
+	SORT2_(T, _s3a, _s3b, LESS, CTX); \
+	SORT2_(T, _s3b, _s3c, LESS, CTX); \
+	SORT2_(T, _s3a, _s3b, LESS, CTX); \
+} while (0)
+
+/// Insertion sort of `[LO, HI)`.  With `LIMIT` non-zero, gives up
+/// (setting `OK` false) once more than `LIMIT` elements have been moved.
+#define SORT_INSERTION_(T, LO, HI, LESS, CTX, LIMIT, OK) do { \
+	typeof(T) *_ilo = (LO), *_ihi = (HI); \
+	usize _moves = 0; \
+	OK = true; \
+	for (typeof(T) *_in = _ilo + 1; _in < _ihi; ++_in) { \
+		typeof(T) *_j = _in; \
+		unless (LESS(CTX, _j, _j - 1)) continue; \
+		T _tmp = *_j; \
+		do { *_j = *(_j - 1); --_j; } \
+		while (_j > _ilo && LESS(CTX, &_tmp, _j - 1)); \
+		*_j = _tmp; \
+		_moves += _in - _j; \
+		if ((LIMIT) > 0 && _moves > (LIMIT)) { OK = false; break; } \
+	} \
+} while (0)
+
+/// Sift the element at `ROOT` down the heap of `END` elements at `H`.
+#define SORT_SIFT_(T, H, ROOT, END, LESS, CTX) do { \
+	for (usize _p = (ROOT), _c; (_c = 2 * _p + 1) < (END); _p = _c) { \
+		if (_c + 1 < (END) && LESS(CTX, (H) + _c, (H) + _c + 1)) ++_c; \
+		unless (LESS(CTX, (H) + _p, (H) + _c)) break; \
+		SORT_SWAP_(T, (H) + _p, (H) + _c); \
+	} \
+} while (0)
+
+/// Heap sort of `[LO, HI)`.
+#define SORT_HEAP_(T, LO, HI, LESS, CTX) do { \
+	T *_h = (LO); \
+	usize _hn = (HI) - _h; \
+	for (usize _k = _hn / 2; _k-- > 0;) \
+		SORT_SIFT_(T, _h, _k, _hn, LESS, CTX); \
+	for (usize _end = _hn; _end-- > 1;) { \
+		SORT_SWAP_(T, _h, _h + _end); \
+		SORT_SIFT_(T, _h, 0, _end, LESS, CTX); \
+	} \
+} while (0)
+
+/// The body of the sort, sorting `LEN` elements of type `T` at `XS`,
+/// with `LESS(CTX, a, b)` telling whether `*a` goes before `*b`.
+/// Recursion is replaced by a stack of ranges, always deferring the
+/// larger half, so it is never deeper than the bits in a `usize`.
+#define SORT_BODY(T, XS, LEN, LESS, CTX) do { \
+	struct { typeof(T) *lo, *hi; usize bad; bool leftmost; } \
+		_stack[sizeof(usize) * CHAR_BIT + 1]; \
+	usize _top = 0, _len = (LEN); \
+	if (_len > 1) { \
+		_stack[0].lo = (XS); _stack[0].hi = (XS) + _len; \
+		_stack[0].bad = sizeof(usize) * CHAR_BIT - __builtin_clzl(_len); \
+		_stack[0].leftmost = true; \
+		_top = 1; \
+	} \
+	while (_top > 0) { \
+		--_top; \
+		typeof(T) *_lo = _stack[_top].lo, *_hi = _stack[_top].hi; \
+		usize _bad = _stack[_top].bad; \
+		bool _leftmost = _stack[_top].leftmost, _ok; \
+		for (;;) { \
+			usize _size = _hi - _lo; \
+			if (_size < SORT_INSERTION_CUTOFF) { \
+				SORT_INSERTION_(T, _lo, _hi, LESS, CTX, 0, _ok); \
+				UNUSED(_ok); \
+				break; \
+			} \
+			/* Median of three (or of three medians) pivot, into *_lo. */ \
+			usize _half = _size / 2; \
+			if (_size > SORT_NINTHER_CUTOFF) { \
+				SORT3_(T, _lo, _lo + _half, _hi - 1, LESS, CTX); \
+				SORT3_(T, _lo + 1, _lo + _half - 1, _hi - 2, LESS, CTX); \
+				SORT3_(T, _lo + 2, _lo + _half + 1, _hi - 3, LESS, CTX); \
+				SORT3_(T, _lo + _half - 1, _lo + _half, _lo + _half + 1, LESS, CTX); \
+				SORT_SWAP_(T, _lo, _lo + _half); \
+			} else { \
+				SORT3_(T, _lo + _half, _lo, _hi - 1, LESS, CTX); \
+			} \
+			/* Pivot equal to the element before the range (which is */ \
+			/* no greater than any in it): put all equal ones left, done. */ \
+			if (!_leftmost && !LESS(CTX, _lo - 1, _lo)) { \
+				T _pivot = *_lo; \
+				typeof(T) *_first = _lo, *_last = _hi; \
+				while (LESS(CTX, &_pivot, --_last)); \
+				if (_last + 1 == _hi) \
+					while (_first < _last && !LESS(CTX, &_pivot, ++_first)); \
+				else \
+					while (!LESS(CTX, &_pivot, ++_first)); \
+				while (_first < _last) { \
+					SORT_SWAP_(T, _first, _last); \
+					while (LESS(CTX, &_pivot, --_last)); \
+					while (!LESS(CTX, &_pivot, ++_first)); \
+				} \
+				*_lo = *_last; *_last = _pivot; \
+				_lo = _last + 1; \
+				continue; \
+			} \
+			/* Partition around the pivot, elements equal going right. */ \
+			T _pivot = *_lo; \
+			typeof(T) *_first = _lo, *_last = _hi; \
+			while (LESS(CTX, ++_first, &_pivot)); \
+			if (_first - 1 == _lo) \
+				while (_first < _last && !LESS(CTX, --_last, &_pivot)); \
+			else \
+				while (!LESS(CTX, --_last, &_pivot)); \
+			bool _partitioned = _first >= _last; \
+			while (_first < _last) { \
+				SORT_SWAP_(T, _first, _last); \
+				while (LESS(CTX, ++_first, &_pivot)); \
+				while (!LESS(CTX, --_last, &_pivot)); \
+			} \
+			T *_mid = _first - 1; \
+			*_lo = *_mid; *_mid = _pivot; \
+			\
+			usize _lsize = _mid - _lo, _rsize = _hi - (_mid + 1); \
+			if (_lsize < _size / 8 || _rsize < _size / 8) { \
+				/* Too unbalanced: after too many, give up on quicksort, */ \
+				/* otherwise break up whatever pattern caused it. */ \
+				if (--_bad == 0) { \
+					SORT_HEAP_(T, _lo, _hi, LESS, CTX); \
+					break; \
+				} \
+				if (_lsize >= SORT_INSERTION_CUTOFF) { \
+					SORT_SWAP_(T, _lo, _lo + _lsize / 4); \
+					SORT_SWAP_(T, _mid - 1, _mid - _lsize / 4); \
+				} \
+				if (_rsize >= SORT_INSERTION_CUTOFF) { \
+					SORT_SWAP_(T, _mid + 1, _mid + 1 + _rsize / 4); \
+					SORT_SWAP_(T, _hi - 1, _hi - _rsize / 4); \
+				} \
+			} else if (_partitioned) { \
+				/* Nothing moved, so the input may be (nearly) sorted. */ \
+				bool _left_ok, _right_ok; \
+				SORT_INSERTION_(T, _lo, _mid, LESS, CTX, \
+					SORT_PARTIAL_INSERTION_LIMIT, _left_ok); \
+				SORT_INSERTION_(T, _mid + 1, _hi, LESS, CTX, \
+					SORT_PARTIAL_INSERTION_LIMIT, _right_ok); \
+				if (_left_ok && _right_ok) break; \
+			} \
+			/* Defer the larger side, carry on with the smaller one. */ \
+			if (_lsize > _rsize) { \
+				_stack[_top].lo = _lo; _stack[_top].hi = _mid; \
+				_stack[_top].leftmost = _leftmost; \
+				_lo = _mid + 1; _leftmost = false; \
+			} else { \
+				_stack[_top].lo = _mid + 1; _stack[_top].hi = _hi; \
+				_stack[_top].leftmost = false; \
+				_hi = _mid; \
+			} \
+			_stack[_top++].bad = _bad; \
+		} \
+	} \
+} while (0)
+
+/// Define `static u0 NAME(T *xs, usize len)`, sorting in place
+/// with `LESS(a, b)`, a macro (or inline function) telling whether
+/// `*a` goes before `*b`, given pointers to two elements.
+#define DEFINE_SORT(NAME, T, LESS) \
+	__attribute__((unused)) \
+	static u0 NAME(T *xs, usize len) \
+	{ SORT_BODY(T, xs, len, SORT_BY_LESS, LESS); }
+
+/// Comparison function, as for `qsort`.
+typedef int (*Comparison)(const u0 *, const u0 *);
+
+/// Sort an array or slice of elements, each `width` bytes, with a
+/// comparison function (called through its pointer).
+/// Elements of 1, 2, 4, 8 or 16 bytes are moved as whole words.
+extern u0 sort_with(u0 *self, usize width, Comparison compare);
+/// Sort in parallel, on the workers of `workers_default()`, with up to
+/// `threads` threads (or with all of them, for zero).  Chunks are sorted
+/// with `sort_with`, then merged pairwise, every merge being split up
+/// between the threads.  Like `sort_with`, it is not stable.
+/// Needs a scratch buffer as large as the array.
+extern u0 psort(u0 *self, usize width, Comparison compare, usize threads);
+typedef struct _WorkerPool WorkerPool;  // See thread.h.
+/// Like `psort`, but on the workers of `pool`, with all of them (and
+/// the caller) for zero `threads`.
+extern u0 psort_on(WorkerPool *pool, u0 *self, usize width, Comparison compare, usize threads);
+
+/// Parallel sort of an array or slice, with a `qsort`-style function.
+#define PSORT(SELF, CMPR, THREADS) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   psort(_self, sizeof(*_self->value), (CMPR), (THREADS)); \
+	   *_self; })
+/// Like `PSORT`, on a given pool of workers.
+#define PSORT_ON(POOL, SELF, CMPR, THREADS) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   psort_on((POOL), _self, sizeof(*_self->value), (CMPR), (THREADS)); \
+	   *_self; })
+
+/// Kind of key for `radix_sort`.
+enum RadixKey {
+	RADIX_UNSIGNED,
+	RADIX_SIGNED,  ///< Two's complement.
+	/// IEEE 754, ordered by their bits, i.e.
+	/// -NaN < -inf < ... < -0 < +0 < ... < +inf < +NaN.
+	RADIX_FLOAT
+}; unqualify(enum, RadixKey);
+
+/// Least-significant digit radix sort of an array or slice of
+/// numbers, each `width` (1, 2, 4 or 8) bytes.  A byte at a time,
+/// skipping bytes which are the same in every element.
+/// Uses a scratch buffer as large as the array, but no comparisons.
+extern u0 radix_sort(u0 *self, usize width, RadixKey key);
+
+#define RADIX_KEY(X) _Generic((X), \
+	float: RADIX_FLOAT, double: RADIX_FLOAT, \
+	signed char: RADIX_SIGNED, short: RADIX_SIGNED, int: RADIX_SIGNED, \
+	long: RADIX_SIGNED, long long: RADIX_SIGNED, \
+	default: RADIX_UNSIGNED)
+
+/// Radix sort an array or slice of integers or floats, in place.
+#define RADIX_SORT(SELF) __extension__\
+	({ __auto_type _self = &(SELF); \
+	   radix_sort(_self, sizeof(*_self->value), RADIX_KEY(*_self->value)); \
+	   *_self; })
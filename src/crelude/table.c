@@ -0,0 +1,271 @@
+#include "table.h"
+#include "simd.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+/// Overflow counts which reach this stay there (until the table grows),
+/// as the entries which passed can no longer be told apart.
+#define TABLE_OVERFLOW_MAX 0xFF
+
+/// Where a probe for some hash has got to.  Groups are visited in
+/// triangular steps (1, 2, 3, ...), so every group is visited once,
+/// the number of them being a power of two.
+record(TableProbe) {
+	usize group, step, mask;
+	u8 tag;  ///< The control byte of the hash's entry.
+};
+
+/// Start a probe.  The hash is mixed first, as hashers such as
+/// `upcast_hash` give back the key as it is.
+static inline TableProbe table_probe(const GenericTable *table, u64 hash)
+{
+	u64 mixed = hash * 0x9E3779B97F4A7C15ull;
+	usize mask = table->buckets.cap / TABLE_GROUP - 1;
+	return (TableProbe){
+		.group = (mixed ^ (mixed >> 32)) & mask,
+		.step = 0,
+		.mask = mask,
+		.tag = mixed >> 57
+	};
+}
+
+static inline u0 probe_next(TableProbe *probe)
+{ probe->group = (probe->group + ++probe->step) & probe->mask; }
+
+static inline u8 *table_overflow(const GenericTable *table)
+{ return table->control + table->buckets.cap; }
+
+static inline umin *table_slot(const GenericTable *table, usize index)
+{ return (umin *)table->buckets.value + index * table->node_size; }
+
+static inline u64 slot_hash(const GenericTable *table, const umin *slot)
+{
+	u64 hash;
+	memcpy(&hash, slot + table->hash_offset, sizeof(u64));
+	return hash;
+}
+
+/// Index of the slot holding `key`, or the capacity if there is none.
+static usize table_find(const GenericTable *table, const u0 *key, u64 hash)
+{
+	usize cap = table->buckets.cap;
+	if (cap == 0) return cap;
+
+	const u8 *overflow = table_overflow(table);
+	TableProbe probe = table_probe(table, hash);
+	for (usize n = 0; n <= probe.mask; ++n) {
+		usize base = probe.group * TABLE_GROUP;
+		u32 matches = bytes16_match(table->control + base, probe.tag);
+		for (; matches != 0; matches &= matches - 1) {
+			usize index = base + __builtin_ctz(matches);
+			const umin *slot = table_slot(table, index);
+			if (slot_hash(table, slot) == hash
+			 && map_keys_equal(table, slot + table->key_offset, key))
+				return index;
+		}
+		if (overflow[probe.group] == 0) break;
+		probe_next(&probe);
+	}
+	return cap;
+}
+
+/// Take the first empty slot along the probe for `hash`, counting
+/// the entry in the overflow of every (full) group it passes.
+static usize table_place(GenericTable *table, u64 hash)
+{
+	u8 *overflow = table_overflow(table);
+	TableProbe probe = table_probe(table, hash);
+	for (;;) {  // There is always an empty slot, the load being < 1.
+		usize base = probe.group * TABLE_GROUP;
+		u32 empty = bytes16_high(table->control + base);
+		if (empty != 0) {
+			usize index = base + __builtin_ctz(empty);
+			table->control[index] = probe.tag;
+			return index;
+		}
+		if (overflow[probe.group] < TABLE_OVERFLOW_MAX)
+			++overflow[probe.group];
+		probe_next(&probe);
+	}
+}
+
+u8 *(table_control)(usize cap, Allocator *allocator)
+{
+	usize bytes = cap + cap / TABLE_GROUP;
+	u8 *control = allocate(allocator, bytes);
+	if (control == nil)
+		PANIC("Could not allocate %zu bytes.", bytes);
+	memset(control, TABLE_EMPTY, cap);
+	memset(control + cap, 0, cap / TABLE_GROUP);
+	return control;
+}
+
+/// Move every entry into a table of `cap` slots.
+static u0 table_rehash(GenericTable *table, usize cap)
+{
+	GenericTable old = *table;
+	usize bytes = cap * table->node_size;
+	table->buckets.value = allocate(table->buckets.alloc, bytes);
+	if (table->buckets.value == nil)
+		PANIC("Could not allocate %zu bytes.", bytes);
+	table->buckets.cap = cap;
+	table->control = table_control(cap, table->buckets.alloc);
+
+	for (usize base = 0; base < old.buckets.cap; base += TABLE_GROUP) {
+		u32 full = ~bytes16_high(old.control + base) & 0xFFFF;
+		for (; full != 0; full &= full - 1) {
+			const umin *slot = table_slot(&old, base + __builtin_ctz(full));
+			usize index = table_place(table, slot_hash(table, slot));
+			memcpy(table_slot(table, index), slot, table->node_size);
+		}
+	}
+	if (old.control != nil) {
+		deallocate(old.buckets.alloc, old.buckets.value, old.buckets.cap * old.node_size);
+		deallocate(old.buckets.alloc, old.control, old.buckets.cap + old.buckets.cap / TABLE_GROUP);
+	}
+}
+
+u0 table_prefetch(const u0 *self, u64 hash)
+{
+	const GenericTable *table = self;
+	if (table->buckets.cap == 0) return UNIT;
+	usize base = table_probe(table, hash).group * TABLE_GROUP;
+	__builtin_prefetch(table->control + base);
+	__builtin_prefetch(table_slot(table, base));
+}
+
+u0 table_reserve(u0 *self, usize count)
+{
+	GenericTable *table = self;
+	if (table->len + count > TABLE_MAX_LOAD(table->buckets.cap))
+		table_rehash(table, table_capacity(table->len + count));
+}
+
+u0 (table_associate)(u0 *self, const u0 *key, const u0 *value)
+{
+	GenericTable *table = self;
+	table_associate_hashed(table, table->hasher(key, table->key_size), key, value);
+}
+
+u0 table_associate_hashed(u0 *self, u64 hash, const u0 *key, const u0 *value)
+{
+	GenericTable *table = self;
+	usize index = table_find(table, key, hash);
+	if (index < table->buckets.cap) {  // Present, so rewrite the value.
+		memcpy(table_slot(table, index) + table->value_offset, value, table->value_size);
+		return UNIT;
+	}
+
+	if (table->len + 1 > TABLE_MAX_LOAD(table->buckets.cap))
+		table_rehash(table, table_capacity(table->len + 1));
+	umin *slot = table_slot(table, table_place(table, hash));
+	memcpy(slot + table->hash_offset, &hash, sizeof(u64));
+	memcpy(slot + table->key_offset, key, table->key_size);
+	memcpy(slot + table->value_offset, value, table->value_size);
+	++table->len;
+	++table->buckets.len;
+}
+
+u0 *table_lookup(u0 *self, const u0 *key)
+{
+	GenericTable *table = self;
+	return table_lookup_hashed(table, table->hasher(key, table->key_size), key);
+}
+
+u0 *table_lookup_hashed(u0 *self, u64 hash, const u0 *key)
+{
+	GenericTable *table = self;
+	usize index = table_find(table, key, hash);
+	if (index == table->buckets.cap) return nil;
+	return table_slot(table, index) + table->value_offset;
+}
+
+bool table_drop(u0 *self, const u0 *key)
+{
+	GenericTable *table = self;
+	u64 hash = table->hasher(key, table->key_size);
+	usize index = table_find(table, key, hash);
+	if (index == table->buckets.cap) return false;
+
+	// No longer count it as having passed the groups before its own.
+	u8 *overflow = table_overflow(table);
+	TableProbe probe = table_probe(table, hash);
+	until (probe.group == index / TABLE_GROUP) {
+		if (overflow[probe.group] < TABLE_OVERFLOW_MAX)
+			--overflow[probe.group];
+		probe_next(&probe);
+	}
+	table->control[index] = TABLE_EMPTY;
+	--table->len;
+	--table->buckets.len;
+	return true;
+}
+
+u0 *table_next_entry(u0 *self, MapCursor *cursor)
+{
+	GenericTable *table = self;
+	usize cap = table->buckets.cap;
+	while (cursor->index < cap) {
+		// the rest of this group's full slots.
+		usize base = cursor->index & -(usize)TABLE_GROUP;
+		u32 full = ~bytes16_high(table->control + base) & 0xFFFF;
+		full &= 0xFFFF << (cursor->index - base);
+		if (full != 0) {
+			usize index = base + __builtin_ctz(full);
+			cursor->index = index + 1;
+			return table_slot(table, index);
+		}
+		cursor->index = base + TABLE_GROUP;
+	}
+	return nil;
+}
+
+u0 table_empty(u0 *self)
+{
+	GenericTable *table = self;
+	usize cap = table->buckets.cap;
+	if (cap == 0) return UNIT;
+	memset(table->control, TABLE_EMPTY, cap);
+	memset(table_overflow(table), 0, cap / TABLE_GROUP);
+	table->len = 0;
+	table->buckets.len = 0;
+}
+
+u0 table_free(u0 *self)
+{
+	GenericTable *table = self;
+	usize cap = table->buckets.cap;
+	if (table->control != nil) {
+		deallocate(table->buckets.alloc, table->buckets.value, cap * table->node_size);
+		deallocate(table->buckets.alloc, table->control, cap + cap / TABLE_GROUP);
+	}
+	table->buckets.value = nil;
+	table->control = nil;
+	table->buckets.cap = table->buckets.len = 0;
+	table->len = 0;
+}
+
+u0 table_dump(u0 *self, byte *key_fmt, byte *value_fmt)
+{
+	GenericTable *table = self;
+	eprintln("entries:     %zu", table->len);
+	eprintln("slots:       %zu", table->buckets.cap);
+	for (usize base = 0; base < table->buckets.cap; base += TABLE_GROUP) {
+		eprint("| %02zu | overflow: %u |", base / TABLE_GROUP,
+			table_overflow(table)[base / TABLE_GROUP]);
+		for (usize i = base; i < base + TABLE_GROUP; ++i) {
+			if (table->control[i] & TABLE_EMPTY) continue;
+			struct { umin _[16]; } key = { 0 }, value = { 0 };
+			umin *slot = table_slot(table, i);
+			memcpy(&key, slot + table->key_offset, min(table->key_size, sizeof(key)));
+			memcpy(&value, slot + table->value_offset, min(table->value_size, sizeof(value)));
+			string formatter = sprint(" [%s (%06llX): %s]",
+			                          key_fmt, slot_hash(table, slot), value_fmt);
+			eprint(PTR(formatter), key, value);
+		}
+		eprint("\n");
+	}
+}
+
+#endif
@@ -0,0 +1,98 @@
+//! @file table.h
+//! Hash-tables with open addressing (i.e. "Swiss tables"), working with
+//! the same `ASSOCIATE`, `LOOKUP`, `DROP`, `HAS_KEY`, `FOR_EACH_ENTRY`,
+//! `free_map`, etc. as `mapof`.  Entries live in one flat array of slots,
+//! with a control byte per slot holding seven bits of its hash (or marking
+//! it empty), so a probe checks a group of 16 slots with a few vector
+//! instructions, and only looks at slots whose byte matches.
+//! There are no chains, and no nodes to allocate.  Deletion leaves
+//! no tombstones: every group counts the entries that had to probe past
+//! it (having found it full), and a probe stops at the first group not
+//! passed by any, so a deleted slot is simply marked empty again.
+//! e.g.
+//! ```c
+//! tableof(i32, string) names = TMAKE(i32, string, 1000);
+//! ASSOCIATE(names, 42, STR("answer"));
+//! string *name = LOOKUP(names, 42);
+//! DROP(names, 42);
+//! free_map(&names);
+//! ```
+
+#pragma once
+#include "common.h"
+
+/// Slots are probed in groups of this many.
+#define TABLE_GROUP 16
+/// Control byte of an empty slot.  Those of full ones are 7-bit tags.
+#define TABLE_EMPTY 0x80
+/// Most entries a table of `CAP` slots holds, before it grows.
+#define TABLE_MAX_LOAD(CAP) ((CAP) - (CAP) / 8)
+
+#define tableslot(K, V) struct { \
+	hashof(K) key; \
+	V value; \
+}
+#define newtable(NT, K, V) typedef tableof(K, V) NT
+#define tableof(K, V) struct { \
+	/* `buckets` are the slots, and their `cap` a power of two. */ \
+	MAP_HEADER_(tableslot(K, V)) \
+	u8 *control; /* < a byte per slot, then an overflow count per group. */ \
+}
+/// Table that maps `void *` to `void *`.
+newtable(GenericTable, u0 *, u0 *);
+
+/// Number of slots holding `count` entries (without growing).
+static inline usize table_capacity(usize count)
+{
+	usize cap = TABLE_GROUP;
+	while (TABLE_MAX_LOAD(cap) < count) cap *= 2;
+	return cap;
+}
+
+/// Control bytes for a table of `cap` slots, all empty.
+extern u8 *table_control(usize cap, Allocator *);
+/// The generic map functions (`associate`, `lookup`, etc.) call these,
+/// when given a `tableof`.
+extern u0 table_associate(u0 *self, const u0 *key, const u0 *value);
+extern u0 *table_lookup(u0 *self, const u0 *key);
+/// Likewise, given the hash of the key (by the table's `hasher`),
+/// for `associate_many` and `lookup_many`.
+extern u0 table_associate_hashed(u0 *self, u64 hash, const u0 *key, const u0 *value);
+extern u0 *table_lookup_hashed(u0 *self, u64 hash, const u0 *key);
+/// Fetch where a key of the given hash would be, into the cache.
+extern u0 table_prefetch(const u0 *self, u64 hash);
+extern u0 table_reserve(u0 *self, usize count);
+extern bool table_drop(u0 *self, const u0 *key);
+extern u0 *table_next_entry(u0 *self, MapCursor *cursor);
+extern u0 table_empty(u0 *self);
+extern u0 table_free(u0 *self);
+extern u0 table_dump(u0 *self, byte *key_formatter, byte *value_formatter);
+
+#ifdef CRELUDE_PROFILE
+	#define table_control(...)   PROFILE_CALL(table_control, __VA_ARGS__)
+	#define table_associate(...) PROFILE_CALL_U0(table_associate, __VA_ARGS__)
+#endif
+
+/// Allocates a table with room for `CAP` entries, before it grows.
+#define TMAKE(K, V, CAP) TMAKE_WITH(K, V, CAP, nil)
+/// Like `TMAKE`, but slots and control bytes are allocated with `ALLOC`.
+#define TMAKE_WITH(K, V, CAP, ALLOC) { \
+	.len = 0, \
+	.buckets = AMAKE_WITH(tableslot(K, V), table_capacity(CAP), ALLOC), \
+	.key_size = sizeof(K), \
+	.value_size = sizeof(V), \
+	.node_size = sizeof(tableslot(K, V)), \
+	.hash_offset  = offsetof(tableslot(K, V), key) + offsetof(hashof(K), hash), \
+	.key_offset   = offsetof(tableslot(K, V), key) + offsetof(hashof(K), value), \
+	.value_offset = offsetof(tableslot(K, V), value), \
+	.next_offset  = 0, \
+	.key_type = MAP_KEY_TYPE(K), \
+	.hasher = MAP_HASHER(K), \
+	.engine = MAP_TABLE, \
+	.control = table_control(table_capacity(CAP), ALLOC) \
+}
+/// Create new table / initialise table from table variable.
+#define TNEW(VARIABLE, CAP) (typeof(VARIABLE))TMAKE( \
+	typeof((VARIABLE).buckets.value[0].key.value), \
+	typeof((VARIABLE).buckets.value[0].value), \
+	CAP)
@@ -0,0 +1,135 @@
+#include "thread.h"
+#include "io.h"
+
+#ifndef IMPLEMENTATION
+
+/// Whether this thread is inside a task, in which case it
+/// must not wait on another batch (which may need it to finish).
+static _Thread_local bool in_task = false;
+
+usize hardware_threads()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : (usize)n;
+}
+
+/// Take and run tasks from the current batch until there are none left.
+static u0 work(WorkerPool *pool)
+{
+	usize tasks = pool->tasks;
+	u0 (*task)(u0 *, usize) = pool->task;
+	u0 *context = pool->context;
+
+	in_task = true;
+	for (;;) {
+		usize i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+		if (i >= tasks) break;
+		task(context, i);
+		if (__atomic_add_fetch(&pool->finished, 1, __ATOMIC_ACQ_REL) == tasks) {
+			pthread_mutex_lock(&pool->lock);
+			pthread_cond_broadcast(&pool->done);
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+	in_task = false;
+}
+
+static u0 *worker(u0 *argument)
+{
+	WorkerPool *pool = argument;
+	usize seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->stopping && pool->batch == seen)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		if (pool->stopping) break;
+		seen = pool->batch;
+		++pool->active;
+		pthread_mutex_unlock(&pool->lock);
+
+		work(pool);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->active == 0)
+			pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return nil;
+}
+
+u0 workers_start(WorkerPool *pool, usize threads)
+{
+	*pool = (WorkerPool){ .count = threads };
+	pthread_mutex_init(&pool->lock, nil);
+	pthread_mutex_init(&pool->running, nil);
+	pthread_cond_init(&pool->wake, nil);
+	pthread_cond_init(&pool->done, nil);
+	pool->threads = emalloc(max(threads, (usize)1), sizeof(pthread_t));
+	for (usize i = 0; i < threads; ++i)
+		unless (pthread_create(&pool->threads[i], nil, worker, pool) == 0)
+			PANIC("Could not start worker thread %zu of %zu.", i + 1, threads);
+}
+
+u0 workers_stop(WorkerPool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	for (usize i = 0; i < pool->count; ++i)
+		pthread_join(pool->threads[i], nil);
+
+	FREE(pool->threads);
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->running);
+	pthread_mutex_destroy(&pool->lock);
+	pool->count = 0;
+}
+
+u0 workers_run(WorkerPool *pool, usize tasks,
+               u0 (*task)(u0 *context, usize index), u0 *context)
+{
+	if (tasks == 0) return UNIT;
+	if (in_task || pool->count == 0 || tasks == 1) {
+		for (usize i = 0; i < tasks; ++i) task(context, i);
+		return UNIT;
+	}
+
+	pthread_mutex_lock(&pool->running);
+	pthread_mutex_lock(&pool->lock);
+	// Late workers may still be leaving the last batch.
+	while (pool->active > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pool->task = task;
+	pool->context = context;
+	pool->tasks = tasks;
+	pool->next = 0;
+	pool->finished = 0;
+	++pool->batch;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	work(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (__atomic_load_n(&pool->finished, __ATOMIC_ACQUIRE) < tasks)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_unlock(&pool->running);
+}
+
+static WorkerPool default_pool;
+static pthread_once_t default_pool_once = PTHREAD_ONCE_INIT;
+
+static u0 start_default_pool()
+{ workers_start(&default_pool, hardware_threads() - 1); }
+
+WorkerPool *workers_default()
+{
+	pthread_once(&default_pool_once, start_default_pool);
+	return &default_pool;
+}
+
+#endif
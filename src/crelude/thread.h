@@ -0,0 +1,50 @@
+//! @file thread.h
+//! A pool of worker threads, which run batches of tasks.
+//! A batch is a number of tasks, each given its index, and the thread
+//! that submits it works on it too, returning once all are done.
+//! e.g.
+//! ```c
+//! static u0 square(u0 *context, usize i)
+//! { u64 *xs = context; xs[i] *= xs[i]; }
+//!
+//! workers_run(workers_default(), len, square, xs);
+//! ```
+
+#pragma once
+#include "common.h"
+
+#include <pthread.h>
+
+record(WorkerPool) {
+	pthread_t *threads;
+	usize count;  ///< Number of worker threads, besides the caller.
+	pthread_mutex_t lock;
+	pthread_cond_t wake;  ///< Signalled when a batch is started.
+	pthread_cond_t done;  ///< Signalled when a batch may be finished.
+	pthread_mutex_t running;  ///< Held for as long as a batch runs.
+	/// The current batch.
+	u0 (*task)(u0 *context, usize index);
+	u0 *context;
+	usize tasks;
+	usize next;      ///< Index of the next task to take (atomic).
+	usize finished;  ///< Number of tasks finished (atomic).
+	usize active;    ///< Workers still inside the batch.
+	usize batch;     ///< Counts batches, so workers see new ones.
+	bool stopping;
+};
+
+/// Number of threads the machine can run at once.
+extern usize hardware_threads(void);
+/// Start a pool of `threads` worker threads (which may be zero).
+extern u0 workers_start(WorkerPool *, usize threads);
+/// Stop and join the worker threads, once they are idle.
+extern u0 workers_stop(WorkerPool *);
+/// Run `task(context, i)` for every `i < tasks`, spread over the
+/// workers and the calling thread, and wait for them all to finish.
+/// Batches are run one at a time; one submitted from within a task
+/// is run serially, by that thread.
+extern u0 workers_run(WorkerPool *, usize tasks,
+                      u0 (*task)(u0 *context, usize index), u0 *context);
+/// Pool shared by the library, with a worker for every hardware
+/// thread but one, started on first use.
+extern WorkerPool *workers_default(void);
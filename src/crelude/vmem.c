@@ -0,0 +1,144 @@
+#include "vmem.h"
+#include "io.h"
+
+#include <sys/mman.h>
+
+#ifndef IMPLEMENTATION
+
+/// Every block starts with a header page, which records its reservation.
+/// ```
+/// |--header page--|--------data-------:----(untouched reservation)----|
+/// ^ mapping       ^ pointer handed out
+/// ```
+record(VMemHeader) {
+	usize reserved;  ///< Size of the whole mapping, header included.
+};
+
+static usize page_size(void)
+{
+	static usize size = 0;
+	if (size == 0) size = sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+static inline usize round_up(usize n, usize to)
+{ return (n + to - 1) / to * to; }
+
+static VMemHeader *header_of(u0 *ptr)
+{ return (VMemHeader *)((umin *)ptr - page_size()); }
+
+/// Size of mapping needed for `bytes` of data.
+static usize mapping_size(const VirtualMemory *vm, usize bytes)
+{
+	usize size = page_size() + max(bytes, vm->reserve);
+	return round_up(size, vm->huge_pages ? VMEM_HUGE_PAGE_SIZE : page_size());
+}
+
+static u0 advise(const VirtualMemory *vm, umin *base, usize size)
+{
+	UNUSED(vm, base, size);
+#ifdef MADV_HUGEPAGE
+	if (vm->huge_pages)
+		madvise(base, size, MADV_HUGEPAGE);
+#endif
+}
+
+static u0 *vmem_alloc(u0 *context, usize bytes)
+{
+	const VirtualMemory *vm = context;
+	usize size = mapping_size(vm, bytes);
+	umin *base = mmap(nil, size, PROT_READ | PROT_WRITE,
+	                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) return nil;
+	advise(vm, base, size);
+
+	((VMemHeader *)base)->reserved = size;
+	return base + page_size();
+}
+
+static u0 vmem_free(u0 *context, u0 *ptr, usize bytes)
+{
+	UNUSED(context, bytes);
+	VMemHeader *header = header_of(ptr);
+	munmap(header, header->reserved);
+}
+
+/// Zero out `bytes` at `ptr`, giving whole pages back to the system.
+static u0 discard(umin *ptr, usize bytes)
+{
+	usize page = page_size();
+	umin *pages = (umin *)round_up((uptr)ptr, page);
+	umin *end = ptr + bytes;
+	if (pages >= end) {
+		zero(ptr, bytes);
+		return UNIT;
+	}
+	zero(ptr, pages - ptr);
+	usize whole = (end - pages) / page * page;
+#if defined(__linux__) && defined(MADV_DONTNEED)
+	// Private anonymous pages read back as zero after this.
+	if (whole > 0 && madvise(pages, whole, MADV_DONTNEED) == 0)
+		pages += whole;
+#endif
+	zero(pages, end - pages);
+}
+
+static u0 *vmem_realloc(u0 *context, u0 *ptr, usize old_bytes, usize new_bytes)
+{
+	const VirtualMemory *vm = context;
+	VMemHeader *header = header_of(ptr);
+	usize reserved = header->reserved;
+
+	if (page_size() + new_bytes <= reserved) {
+		// Fits in the reservation; pages get committed once touched.
+		// When shrinking, the tail must read as zero if it is regrown.
+		if (new_bytes < old_bytes)
+			discard((umin *)ptr + new_bytes, old_bytes - new_bytes);
+		return ptr;
+	}
+
+	usize size = mapping_size(vm, new_bytes);
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+	// Moves the page-table entries, the data itself is not copied.
+	umin *base = mremap(header, reserved, size, MREMAP_MAYMOVE);
+	if (base == MAP_FAILED) return nil;
+	advise(vm, base, size);
+	((VMemHeader *)base)->reserved = size;
+	return base + page_size();
+#else
+	u0 *new = vmem_alloc(context, new_bytes);
+	if (new == nil) return nil;
+	memcpy(new, ptr, min(old_bytes, new_bytes));
+	vmem_free(context, ptr, old_bytes);
+	return new;
+#endif
+}
+
+static VirtualMemory default_vmem = {
+	.reserve = 0,
+	.huge_pages = false,
+	.allocator = { 0 }
+};
+
+Allocator VMEM_ALLOCATOR = {
+	.alloc = vmem_alloc,
+	.realloc = vmem_realloc,
+	.free = vmem_free,
+	.context = &default_vmem,
+	.zeroed = true
+};
+
+u0 vmem_init(VirtualMemory *vm, usize reserve, bool huge_pages)
+{
+	vm->reserve = reserve;
+	vm->huge_pages = huge_pages;
+	vm->allocator = (Allocator){
+		.alloc = vmem_alloc,
+		.realloc = vmem_realloc,
+		.free = vmem_free,
+		.context = vm,
+		.zeroed = true
+	};
+}
+
+#endif
@@ -0,0 +1,46 @@
+//! @file vmem.h
+//! Virtual-memory backed allocation, for very large arrays.
+//! Blocks are anonymous `mmap`s, reserved up front, and grown
+//! in place or with `mremap` (on Linux), such that growing an array
+//! does not copy it, and does not double the resident memory.
+//! e.g.
+//! ```c
+//! VirtualMemory vm;
+//! vmem_init(&vm, 64 * GIBIBYTE, true);  //< reserve 64 GiB, huge pages.
+//! arrayof(u64) ids = AMAKE_WITH(u64, 1024, &vm.allocator);
+//! ```
+
+#pragma once
+#include "common.h"
+
+#define KIBIBYTE ((usize)1024)
+#define MEBIBYTE (1024 * KIBIBYTE)
+#define GIBIBYTE (1024 * MEBIBYTE)
+
+/// Size of transparent huge pages that reservations are rounded to.
+#define VMEM_HUGE_PAGE_SIZE (2 * MEBIBYTE)
+
+record(VirtualMemory) {
+	/// Address space reserved for every block up front.  Growing within
+	/// the reservation never moves the block; pages are only committed
+	/// once they are touched.
+	usize reserve;
+	/// Advise the kernel to back blocks with transparent huge pages.
+	bool huge_pages;
+	/// Allocator interface, to be carried by (large) arrays.
+	/// Memory it gives out is always zeroed.
+	Allocator allocator;
+};
+
+/// Allocator with no up-front reservation, and without huge pages.
+/// Blocks are grown by `mremap`, or by copying where that is unavailable.
+extern Allocator VMEM_ALLOCATOR;
+
+/// Initialise a virtual memory allocator.
+/// @param[out] vm The allocator state, which must not move after this.
+/// @param[in] reserve Bytes of address space to reserve per block.
+/// @param[in] huge_pages Whether to opt in to transparent huge pages.
+extern u0 vmem_init(VirtualMemory *vm, usize reserve, bool huge_pages);
+
+/// Heap allocates an array which grows without copying.
+#define AMAKE_LARGE(TYPE, CAP) AMAKE_WITH(TYPE, CAP, &VMEM_ALLOCATOR)
@@ -7,6 +7,19 @@
 #include <crelude/utf.h>
 #include <crelude/base64.h>
 #include <crelude/argparse.h>
+#include <crelude/arena.h>
+#include <crelude/vmem.h>
+#include <crelude/profile.h>
+#include <crelude/simd.h>
+#include <crelude/byteorder.h>
+#include <crelude/deque.h>
+#include <crelude/segment.h>
+#include <crelude/bitset.h>
+#include <crelude/sort.h>
+#include <crelude/thread.h>
+#include <crelude/search.h>
+#include <crelude/parallel.h>
+#include <crelude/table.h>
 
 #include <stdio.h>
 #include <locale.h>
@@ -16,6 +29,38 @@
 		ANSI(UNDER) "Test Case" ANSI(RESET) ": %s", DOES); \
 } while (false); always
 
+newarray(Ints, int);
+DEFINE_ARRAY_OPS(Ints, int)
+
+#define BY_VALUE(A, B) (*(A) < *(B))
+DEFINE_SORT(sort_ints, int, BY_VALUE)
+DEFINE_SEARCH(search_ints, int, BY_VALUE)
+
+static int compare_ints(const u0 *a, const u0 *b)
+{ return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b); }
+
+record(Triple) { u64 key, a, b; };  // An element of odd width.
+
+static int compare_triples(const u0 *a, const u0 *b)
+CMP(((const Triple *)a)->key, ((const Triple *)b)->key)
+
+static u0 add_squares(u0 *context, usize i)
+{ __atomic_fetch_add((u64 *)context, (u64)i * i, __ATOMIC_RELAXED); }
+
+#define ADD(A, B) ((A) + (B))
+/// Not commutative, but associative: keeps the later of two non-zeros.
+#define LATEST(A, B) ((B) != 0 ? (B) : (A))
+#define IS_ODD(X) ((X) % 2 != 0)
+
+static i64 cube(i32 x) { return (i64)x * x * x; }
+static u0 negate(i32 *x) { *x = -*x; }
+
+static u0 run_nested(u0 *context, usize i)
+{
+	UNUSED(i);
+	workers_run(workers_default(), 100, add_squares, context);
+}
+
 u0 utf8_ucs4_conversions(byte *cstring)
 {
 	// UTF-8 string.
@@ -41,6 +86,32 @@ u0 utf8_ucs4_conversions(byte *cstring)
 
 newtype(Natural, u64);  // New-type idiom.
 
+/// Allocator which counts its live allocations and bytes.
+record(CountingAllocator) { isize blocks, bytes; };
+
+static u0 *counting_alloc(u0 *context, usize bytes)
+{
+	CountingAllocator *counter = context;
+	++counter->blocks;
+	counter->bytes += bytes;
+	return malloc(bytes);
+}
+
+static u0 *counting_realloc(u0 *context, u0 *ptr, usize old, usize new)
+{
+	CountingAllocator *counter = context;
+	counter->bytes += (isize)new - (isize)old;
+	return realloc(ptr, new);
+}
+
+static u0 counting_free(u0 *context, u0 *ptr, usize bytes)
+{
+	CountingAllocator *counter = context;
+	--counter->blocks;
+	counter->bytes -= bytes;
+	free(ptr);
+}
+
 #ifndef IMPLEMENTATION
 
 ierr main(i32 argc, const byte **argv)
@@ -294,7 +365,7 @@ ierr main(i32 argc, const byte **argv)
 		assert(is_empty_map(&dict));
 
 		mapof(i32, string) table = MMAKE(i32, string, 3);
-		assert(table.hasher == upcast_hash);
+		assert(table.hasher == integer_hash);
 
 		string hello = STRING("Hello, ");
 		string world = STRING("World!");
@@ -318,6 +389,978 @@ ierr main(i32 argc, const byte **argv)
 		assert(is_empty_map(&table));
 	}
 
+	TEST("Custom allocators for arrays, maps and formatting") {
+		CountingAllocator counter = { 0 };
+		Allocator counting = {
+			.alloc = counting_alloc,
+			.realloc = counting_realloc,
+			.free = counting_free,
+			.context = &counter
+		};
+
+		arrayof(int) xs = AMAKE_WITH(int, 2, &counting);
+		for (int i = 0; i < 100; ++i) PUSH(xs, i);
+		assert(counter.blocks == 1);
+		assert(counter.bytes == (isize)(xs.cap * sizeof(int)));
+		println("xs.len = %zu, xs.cap = %zu, last = %d", xs.len, xs.cap, LAST(xs));
+		AFREE(xs);
+		assert(counter.blocks == 0 && counter.bytes == 0);
+
+		mapof(i32, u64) squares = MMAKE_WITH(i32, u64, 4, &counting);
+		for (i32 i = 0; i < 64; ++i) ASSOCIATE(squares, i * 5, (u64)(i * i));
+		for (i32 i = 0; i < 64; ++i) DROP(squares, i * 5);
+		for (i32 i = 0; i < 64; ++i) ASSOCIATE(squares, -i, (u64)(i * i));
+		assert(*LOOKUP(squares, -7) == 49);
+		// Chain nodes are recycled by the map's pool, not reallocated.
+		isize blocks = counter.blocks;
+		for (i32 i = 0; i < 64; ++i) DROP(squares, -i);
+		for (i32 i = 0; i < 64; ++i) ASSOCIATE(squares, i * 7, (u64)(i * i));
+		assert(counter.blocks == blocks);
+		assert(squares.len == 64 && *LOOKUP(squares, 7 * 7) == 49);
+		free_map(&squares);
+		println("blocks: %zd, bytes: %zd", counter.blocks, counter.bytes);
+		assert(counter.blocks == 0 && counter.bytes == 0);
+
+		string s = sprint_with(&counting, "%V%d{, } (%s)",
+		                       LIST(sliceof(int), { 1, 2, 3 }), "ok");
+		assert(string_eq(s, STR("1, 2, 3 (ok)")));
+		assert(counter.blocks == 1);
+		deallocate(&counting, s.value, s.len + 1);
+		assert(counter.blocks == 0 && counter.bytes == 0);
+	}
+
+	TEST("Arena allocation, rewinding and resetting") {
+		Arena arena;
+		arena_init(&arena, 256);
+		Allocator *alloc = &arena.allocator;
+
+		StringBuilder sb = AMAKE_WITH(byte, 4, alloc);
+		for (usize i = 0; i < 1000; ++i) PUSH(sb, 'a' + i % 26);
+		assert(sb.len == 1000 && NTH(sb, 27) == 'b');
+
+		ArenaMark mark = arena_mark(&arena);
+		usize used = arena_used(&arena);
+		string s = sprint_with(alloc, "%s has %zu bytes", "sb", sb.len);
+		println("%S (arena: %zu bytes used)", s, arena_used(&arena));
+		assert(string_eq(s, STR("sb has 1000 bytes")));
+
+		string one = STRING("one"), two = STRING("two"), three = STRING("three");
+		mapof(string, i32) counts = MMAKE_WITH(string, i32, 4, alloc);
+		ASSOCIATE(counts, one, 1);
+		ASSOCIATE(counts, two, 2);
+		ASSOCIATE(counts, three, 3);
+		assert(*LOOKUP(counts, two) == 2);
+
+		arena_rewind(&arena, mark);
+		assert(arena_used(&arena) == used);
+		assert(NTH(sb, 999) == 'a' + 999 % 26);  //< still intact.
+
+		arena_reset(&arena);
+		assert(arena_used(&arena) == 0);
+		u0 *first = arena_alloc(&arena, 8);
+		assert(first == arena.first->data);  //< memory is reused.
+		arena_free(&arena);
+	}
+
+	TEST("Formatting temporaries live in thread-local scratch memory") {
+		arrayof(f64) xs = AMAKE(f64, 1000);
+		for (usize i = 0; i < 1000; ++i) PUSH(xs, i / 8.0);
+
+		CountingAllocator counter = { 0 };
+		Allocator counting = {
+			.alloc = counting_alloc,
+			.realloc = counting_realloc,
+			.free = counting_free,
+			.context = &counter
+		};
+		string s = sprint_with(&counting, "%D{%.3f}{, }", xs);
+		assert(counter.blocks == 1 && counter.bytes == (isize)s.len + 1);
+		assert(string_ncmp(s, STR("0.000, 0.125, 0.250"), 19) == 0);
+		println("formatted %zu elements into %zu bytes.", xs.len, s.len);
+		assert(arena_used(scratch_arena()) == 0);
+		deallocate(&counting, s.value, s.len + 1);
+		AFREE(xs);
+	}
+
+	TEST("Large arrays grow in virtual memory") {
+		arrayof(u32) xs = AMAKE_LARGE(u32, 16);
+		for (u32 i = 0; i < 1000000; ++i) PUSH(xs, i * 3);
+		assert(xs.len == 1000000 && xs.value[999999] == 999999 * 3);
+
+		// Shrunk memory reads back as zero when grown again.
+		resize(&xs, 10, sizeof(u32));
+		resize(&xs, 100000, sizeof(u32));
+		assert(xs.value[9] == 27 && xs.value[10] == 0 && xs.value[99999] == 0);
+		AFREE(xs);
+
+		VirtualMemory vm;
+		vmem_init(&vm, 256 * MEBIBYTE, true);
+		arrayof(u64) ys = AMAKE_WITH(u64, 1, &vm.allocator);
+		u64 *first = ys.value;
+		for (u64 i = 0; i < 1 << 20; ++i) PUSH(ys, i);
+		println("pushed %zu words, never moving.", ys.len);
+		assert(ys.value == first && ys.value[12345] == 12345);
+		AFREE(ys);
+	}
+
+#ifdef CRELUDE_PROFILE
+	TEST("Allocations are profiled by call site") {
+		profile_reset();  // Counts start again from zero.
+		AllocStats pushed = profile_totals("push");
+		AllocStats associated = profile_totals("associate");
+
+		arrayof(u16) xs = AMAKE(u16, 1);
+		for (u16 i = 0; i < 100; ++i) PUSH(xs, i);
+		mapof(u16, u16) squares = MMAKE(u16, u16, 4);
+		for (u16 i = 1; i <= 100; ++i) ASSOCIATE(squares, i, i * i);
+		string s = sprint("%D{%hu}", xs);
+		MemSlice encoded = base64_encode(VIEW(MemSlice, (umin *)s.value, 0, s.len));
+
+		AllocStats pushes = profile_totals("push");
+		AllocStats associates = profile_totals("associate");
+		assert(pushes.calls > 0);
+		assert(pushes.live - pushed.live == xs.cap * sizeof(u16));
+		assert(associates.calls > 0 && associates.live > associated.live);
+		assert(profile_totals("novel_sprintf").bytes == s.len + 1);
+		assert(profile_totals("base64_encode").bytes == encoded.len + 1);
+		profile_dump(stdout);
+
+		FREE_INSIDE(encoded);
+		FREE_INSIDE(s);
+		free_map(&squares);
+		AFREE(xs);
+		assert(profile_totals("push").live == pushed.live);
+		assert(profile_totals("associate").live == associated.live);
+		assert(profile_totals("base64_encode").frees == 1);
+	}
+#endif
+
+	TEST("Vectorised memory primitives agree with scalar ones") {
+		umin a[300], b[300], x[300], y[300];
+		for (usize i = 0; i < 300; ++i)
+			a[i] = x[i] = i * 7 + 1, b[i] = y[i] = i * 13 + 5;
+
+		// Every length up to four AVX2 vectors, then in growing strides,
+		// from each of the first eight alignments.
+		for (usize off = 0; off < 8; ++off)
+			for (usize len = 0; off + len <= 300; len += len < 128 ? 1 : 1 + len / 16) {
+				memswap(a + off, b + off, len);
+				memswap_scalar(x + off, y + off, len);
+				assert(memcmp(a, x, 300) == 0 && memcmp(b, y, 300) == 0);
+
+				zero(a + off, len);
+				zero_scalar(x + off, len);
+				assert(memcmp(a, x, 300) == 0);
+				assert(is_zeroed(a + off, len));
+				for (usize i = 0; i < len; i += 1 + len / 4) {
+					a[off + i] = 1;
+					assert(!is_zeroed(a + off, len));
+					assert(is_zeroed(a + off, len) == is_zeroed_scalar(a + off, len));
+					a[off + i] = 0;
+				}
+				for (usize i = 0; i < 300; ++i)
+					a[i] = x[i] = i * 3 + len;
+			}
+		println("checked against scalar code, with %s.", SIMD_NAME);
+	}
+
+	TEST("Rotating memory, through a buffer and by block swaps") {
+		usize size = 3 * ROTATE_BUFFER_SIZE + 17;
+		umin *blk = emalloc(size, 1);
+		for (usize bytes = 0; bytes <= size; bytes += 1 + bytes / 3)
+			for (usize pivot = 0; pivot <= bytes; pivot += 1 + pivot / 2) {
+				for (usize i = 0; i < bytes; ++i) blk[i] = i % 251;
+				memrotate(blk, bytes, pivot);
+				for (usize i = 0; i < bytes; ++i)
+					assert(blk[i] == (i + pivot) % bytes % 251);
+			}
+		FREE(blk);
+
+		arrayof(u32) xs = AMAKE(u32, 100000);
+		for (u32 i = 0; i < 100000; ++i) PUSH(xs, i);
+		for (u32 i = 0; i < 1000; ++i) assert(*SHIFT(xs) == i);
+		assert(xs.len == 99000 && xs.value[0] == 1000);
+		assert(*REMOVE(xs, 500) == 1500 && xs.value[500] == 1501);
+		println("shifted %u elements off the front.", 1000);
+		AFREE(xs);
+	}
+
+	TEST("Reversing arrays of any element width") {
+		usize widths[] = { 1, 2, 3, 4, 5, 8, 12, 16, 24 };
+		umin *xs = emalloc(24 * 200, 1), *ys = emalloc(24 * 200, 1);
+		for (usize w = 0; w < sizeof(widths) / sizeof(usize); ++w)
+			for (usize len = 0; len < 200; len += 1 + len / 8) {
+				usize width = widths[w];
+				for (usize i = 0; i < len * width; ++i)
+					xs[i] = ys[i] = i * 31 + width;
+				MemSlice slice = VIEW(MemSlice, xs, 0, len);
+				reverse(&slice, width);
+				reverse_scalar(ys, len, width);
+				assert(memcmp(xs, ys, len * width) == 0);
+			}
+		FREE(xs);
+		FREE(ys);
+
+		umin be[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x11 };
+		assert(big_endian(be, 2) == 0x0123);
+		assert(big_endian(be, 8) == 0x0123456789ABCDEFull);
+		assert(big_endian(be, 9) == ((u128)0x0123456789ABCDEFull << 8 | 0x11));
+		println("reversed %zu widths, and read big endian numbers.",
+			sizeof(widths) / sizeof(usize));
+	}
+
+	TEST("Bulk byte order conversion") {
+		usize widths[] = { 2, 4, 8, 16 };
+		umin *src = emalloc(16 * 100, 1);
+		umin *dst = emalloc(16 * 100, 1), *ref = emalloc(16 * 100, 1);
+		for (usize i = 0; i < 16 * 100; ++i) src[i] = i * 7 + 3;
+		for (usize w = 0; w < 4; ++w)
+			for (usize len = 0; len <= 100; len += 1 + len / 4) {
+				usize width = widths[w];
+				byteswap(dst, src, len, width);
+				byteswap_scalar(ref, src, len, width);
+				assert(memcmp(dst, ref, len * width) == 0);
+				byteswap(dst, dst, len, width);  // In-place, and back again.
+				assert(memcmp(dst, src, len * width) == 0);
+			}
+		FREE(src);
+		FREE(dst);
+		FREE(ref);
+
+		newslice(Words, u32);
+		_Alignas(u32) umin record[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0x00, 0x00, 0x01, 0x02 };
+		Words words = VIEW(Words, (u32 *)record, 0, 2);
+		FROM_BIG_ENDIAN(words);
+		assert(words.value[0] == 0xDEADBEEF && words.value[1] == 0x0102);
+		TO_LITTLE_ENDIAN(words);
+		assert(record[0] == 0xEF && record[7] == 0x00);
+		println("swapped %zu widths, with %s.", sizeof(widths) / sizeof(usize), SIMD_NAME);
+	}
+
+	TEST("Type-specialised array operations") {
+		Ints xs = AMAKE(int, 2);
+		for (int i = 0; i < 1000; ++i) Ints_push(&xs, i * i);
+		assert(xs.len == 1000 && *Ints_get(&xs, 999) == 999 * 999);
+		assert(Ints_get(&xs, 1000) == nil);
+
+		Ints_set(&xs, 0, -1);
+		Ints_insert(&xs, 1, -2);
+		Ints_extend(&xs, (int[]){ 7, 8, 9 }, 3);
+		assert(xs.value[0] == -1 && xs.value[1] == -2 && xs.value[2] == 1);
+		assert(xs.len == 1004 && *Ints_pop(&xs) == 9);
+
+		usize sum = 0;
+		FOR_EACH(x, xs) sum += x > 0 ? x : 0;
+		println("sum of %zu elements: %zu.", xs.len, sum);
+		AFREE(xs);
+	}
+
+	TEST("Growth policies, reserving and shrinking") {
+		arrayof(u64) xs = AMAKE(u64, 0);
+		xs.growth = &GROWTH_POW2;
+		for (u64 i = 0; i < 100; ++i) {
+			PUSH(xs, i);
+			assert((xs.cap & (xs.cap - 1)) == 0);
+		}
+		assert(xs.cap == 128);
+
+		const GrowthPolicy by_batch = FIXED_GROWTH(50);
+		xs.growth = &by_batch;
+		for (u64 i = 0; i < 100; ++i) PUSH(xs, i);
+		assert(xs.len == 200 && xs.cap == 200);
+
+		xs.growth = &GROWTH_PAGES;
+		PUSH(xs, 0);
+		assert(xs.cap * sizeof(u64) % 4096 == 0);
+
+		assert(RESERVE(xs, 1000) > 0 && xs.cap == xs.len + 1000);
+		assert(RESERVE(xs, 10) == 0);
+		u64 *before = xs.value;
+		for (u64 i = 0; i < 1000; ++i) PUSH(xs, i);
+		assert(xs.value == before && xs.len == 1201);
+
+		CLEAR(xs);
+		assert(xs.len == 0 && xs.cap == 1201);
+		PUSH(xs, 7);
+		assert(SHRINK_TO_FIT(xs) == 1200 && xs.cap == 1 && xs.value[0] == 7);
+		println("shrunk down to %zu element(s).", xs.cap);
+		AFREE(xs);
+	}
+
+	TEST("Small arrays, stored inline") {
+		SMALL_ARRAY(xs, int, 8);
+		for (int i = 0; i < 8; ++i) PUSH(xs, i);
+		assert(IS_INLINE(xs) && xs.value == xs.buffer && xs.cap == 8);
+		assert(SHRINK_TO_FIT(xs) == 0 && IS_INLINE(xs));
+
+		EXTEND(xs, ((sliceof(int))INIT(int, { 8, 9, 10 })));
+		assert(!IS_INLINE(xs) && xs.value != xs.buffer && xs.len == 11);
+		int sum = 0;
+		FOR_EACH(x, xs) sum += x;
+		assert(sum == 55);
+		string listed = sprint("%D{%d}{, }", AVIEW(xs));
+		assert(strcmp(listed.value, "0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10") == 0);
+		FREE(listed.value);
+		AFREE(xs);
+
+		SMALL_ARRAY(builder, byte, 32);
+		sprint_append(&builder, "%s, %S", "hello", STR("world"));
+		string greeting = sprint_append(&builder, "%c", '!');
+		assert(IS_INLINE(builder) && strcmp(greeting.value, "hello, world!") == 0);
+		for (usize i = 0; i < 10; ++i) sprint_append(&builder, " %zu", i);
+		assert(!IS_INLINE(builder) && builder.value[builder.len] == '\0');
+		println("small builder: %S", SLICE(string, builder, 0, builder.len));
+		AFREE(builder);
+
+		struct { u32 id; smallarrayof(u16, 4) codes; } entry = { .id = 1 };
+		SMALL_INIT(entry.codes);
+		PUSH(entry.codes, 0xFFFF);
+		assert(IS_INLINE(entry.codes) && entry.codes.buffer[0] == 0xFFFF);
+		AFREE(entry.codes);
+	}
+
+	TEST("Double-ended queues") {
+		dequeof(int) queue = DMAKE(int, 4);
+		for (int i = 0; i < 6; ++i) PUSH_BACK(queue, i);
+		for (int i = 0; i < 6; ++i) assert(*POP_FRONT(queue) == i);
+		// Wrap around the end of the ring, then grow.
+		for (int i = 0; i < 5; ++i) PUSH_BACK(queue, i);
+		for (int i = 1; i <= 3; ++i) PUSH_FRONT(queue, -i);
+		assert(queue.head + queue.len > queue.cap);
+		for (int i = 5; i < 100; ++i) PUSH_BACK(queue, i);
+		assert(queue.len == 103 && (queue.cap & (queue.cap - 1)) == 0);
+		for (usize i = 0; i < queue.len; ++i)
+			assert(*DGET(queue, i) == (int)i - 3);
+		assert(DGET(queue, queue.len) == nil);
+
+		for (usize i = 0; i < 50; ++i) *PUSH_FRONT(queue, 0) = *POP_BACK(queue);
+		sliceof(int) runs[2];
+		usize count = DVIEWS(queue, 0, queue.len, runs);
+		assert(count == 2 && runs[0].len + runs[1].len == queue.len);
+		int expected = 50;
+		for (usize r = 0; r < count; ++r)
+			FOR_EACH(x, runs[r]) {
+				assert(x == expected);
+				expected = expected == 99 ? -3 : expected + 1;
+			}
+		assert(DVIEWS(queue, 10, 20, runs) == 1 && runs[0].value[0] == 60);
+		assert(DVIEWS(queue, 5, 5, runs) == 0 && runs[0].len == 0);
+		println("deque of %zu (capacity %zu) in %zu run(s).",
+			queue.len, queue.cap, count);
+		DFREE(queue);
+
+		// Mostly wrapped around, so the front part is moved when growing.
+		dequeof(u64) ring = DMAKE(u64, 8);
+		for (u64 i = 0; i < 7; ++i) PUSH_BACK(ring, i);
+		for (u64 i = 0; i < 6; ++i) POP_FRONT(ring);
+		for (u64 i = 7; i < 20; ++i) PUSH_BACK(ring, i);
+		for (usize i = 0; i < ring.len; ++i) assert(*DGET(ring, i) == i + 6);
+		DFREE(ring);
+	}
+
+	TEST("Segmented arrays, with stable addresses") {
+		usize offset;
+		assert(segment_of(0, &offset) == 0 && offset == 0);
+		assert(segment_of(SEGMENT_BASE - 1, &offset) == 0 && offset == SEGMENT_BASE - 1);
+		assert(segment_of(SEGMENT_BASE, &offset) == 1 && offset == 0);
+		assert(segment_of(3 * SEGMENT_BASE, &offset) == 2 && offset == 0);
+
+		segmentedof(u64) xs = { 0 };
+		u64 *first = SEG_PUSH(xs, 0);
+		u64 *ptrs[1000];
+		ptrs[0] = first;
+		for (u64 i = 1; i < 1000; ++i) ptrs[i] = SEG_PUSH(xs, i * i);
+		for (u64 i = 0; i < 1000; ++i)
+			assert(ptrs[i] == SEG_GET(xs, i) && *ptrs[i] == i * i);
+		assert(SEG_GET(xs, 1000) == nil && *first == 0);
+
+		usize seen = 0, runs = 0;
+		SEG_FOR_EACH(x, xs) {
+			assert(x == it.index * it.index && it.ptr == ptrs[it.index]);
+			++seen;
+		}
+		for (usize k = 0; segmented_view(&xs, k).len > 0; ++k)
+			runs += segmented_view(&xs, k).len;
+		assert(seen == 1000 && runs == 1000);
+		SEG_FOR_EACH(x, xs) if (x > 100) { seen = it.index; break; }
+		assert(seen == 11);
+
+		assert(*SEG_POP(xs) == 999 * 999 && xs.len == 999);
+		usize cap = xs.cap;
+		assert(SEG_RESERVE(xs, 5000) > 0 && xs.cap >= xs.len + 5000);
+		assert(SEG_RESERVE(xs, 10) == 0 && cap < xs.cap && *first == 0);
+		println("%zu elements, in segments holding %zu.", xs.len, xs.cap);
+		SEG_FREE(xs);
+		assert(xs.len == 0 && xs.segments[0] == nil);
+	}
+
+	TEST("Bitsets") {
+		Bitset primes = BMAKE(1000);
+		bitset_fill(&primes, 2, primes.len, true);
+		for (usize i = 2; i * i < primes.len; ++i)
+			if (bitset_get(&primes, i))
+				for (usize j = i * i; j < primes.len; j += i)
+					bitset_clear(&primes, j);
+		assert(bitset_count(&primes) == 168);
+		assert(bitset_next(&primes, 0) == 2 && bitset_next(&primes, 998) == 1000);
+		usize last = 0, count = 0;
+		BITSET_FOR_EACH(p, primes) last = p, ++count;
+		assert(last == 997 && count == 168);
+
+		// Ranges within one word, across words, and to the end.
+		Bitset xs = BMAKE(300);
+		bitset_fill(&xs, 3, 9, true);
+		assert(bitset_count(&xs) == 6 && bitset_get(&xs, 8) && !bitset_get(&xs, 9));
+		bitset_fill(&xs, 60, 260, true);
+		assert(bitset_count(&xs) == 206);
+		bitset_fill(&xs, 100, 1000, false);
+		assert(bitset_count(&xs) == 46 && bitset_next(&xs, 9) == 60);
+		bitset_flip(&xs, 299);
+		assert(bitset_next(&xs, 100) == 299);
+
+		Bitset odd = BMAKE(1000), copy = BMAKE(1000);
+		for (usize i = 1; i < odd.len; i += 2) bitset_set(&odd, i);
+		bitset_or(&copy, &primes);
+		bitset_and(&copy, &odd);
+		assert(bitset_count(&copy) == 167 && !bitset_get(&copy, 2));
+		bitset_xor(&copy, &primes);
+		assert(bitset_count(&copy) == 1 && bitset_get(&copy, 2));
+		bitset_andnot(&copy, &primes);
+		assert(bitset_none(&copy));
+		bitset_or(&xs, &odd);  // Longer; must not spill past the end.
+		assert(bitset_count(&xs) == 150 + 3 + 20);  // And the even ones of 3..8, 60..99.
+		bitset_and(&odd, &xs);  // Shorter; the rest is cleared.
+		assert(bitset_count(&odd) == 150 && bitset_next(&odd, 300) == odd.len);
+
+		MemSlice bytes = bitset_bytes(&primes);
+		assert(bytes.len == 16 * sizeof(u64) && (bytes.value[0] & 0x0C) == 0x0C);
+		Bitset view = bitset_view(bytes, primes.len);
+		assert(view.words == primes.words && bitset_count(&view) == 168);
+
+		bitset_resize(&primes, 5000);
+		assert(bitset_count(&primes) == 168 && bitset_next(&primes, 998) == 5000);
+		bitset_resize(&primes, 100);
+		assert(bitset_count(&primes) == 25);
+		println("%zu primes below %zu, %zu bytes.", bitset_count(&primes),
+			primes.len, bitset_bytes(&primes).len);
+		BFREE(primes); BFREE(xs); BFREE(odd); BFREE(copy);
+
+		// The vector popcount against the scalar loop, from every word
+		// alignment (of a vector), over dense and sparse words.
+		u64 words[300];
+		u64 seed = 0x2545F4914F6CDD1Dull;
+		for (usize i = 0; i < 300; ++i) {
+			seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+			words[i] = i % 3 == 0 ? seed : seed & (seed >> 17) & (seed >> 31);
+		}
+		words[7] = ~(u64)0, words[8] = 0;
+		for (usize off = 0; off < 4; ++off)
+			for (usize len = 0; off + len <= 300; len += len < 64 ? 1 : 1 + len / 8)
+				assert(popcount_words(words + off, len) == popcount_scalar(words + off, len));
+		println("popcount checked against scalar code, with %s.", SIMD_NAME);
+	}
+
+	TEST("Type-specialised sorting") {
+		usize lens[] = { 0, 1, 2, 23, 24, 25, 129, 1000, 100000 };
+		newslice(IntSlice, int);
+		for (usize l = 0; l < sizeof(lens) / sizeof(usize); ++l)
+			for (usize pattern = 0; pattern < 6; ++pattern) {
+				usize len = lens[l];
+				IntSlice xs = SMAKE(int, len), ys = SMAKE(int, len), zs = SMAKE(int, len);
+				u64 seed = 42;
+				for (usize i = 0; i < len; ++i) {
+					seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+					int x;
+					switch (pattern) {
+					case 0: x = (int)(seed >> 33); break;         // random.
+					case 1: x = i; break;                        // sorted.
+					case 2: x = len - i; break;                  // reversed.
+					case 3: x = 7; break;                        // all equal.
+					case 4: x = i < len / 2 ? i : len - i; break; // organ pipe.
+					default: x = (seed >> 33) % 4 - 2; break;    // few distinct.
+					}
+					xs.value[i] = ys.value[i] = zs.value[i] = x;
+				}
+				sort_ints(xs.value, xs.len);
+				QSORT(ys, compare_ints);
+				SORT(zs, a, b, CMP(*(const int *)a, *(const int *)b));
+				for (usize i = 1; i < len; ++i)
+					assert(xs.value[i - 1] <= xs.value[i]);
+				assert(memcmp(xs.value, ys.value, len * sizeof(int)) == 0);
+				assert(memcmp(xs.value, zs.value, len * sizeof(int)) == 0);
+
+				RADIX_SORT(zs);  // Already sorted, stays so.
+				assert(memcmp(xs.value, zs.value, len * sizeof(int)) == 0);
+				FREE(xs.value); FREE(ys.value); FREE(zs.value);
+			}
+
+		sliceof(u64) ids = SMAKE(u64, 5000);
+		for (usize i = 0; i < ids.len; ++i) ids.value[i] = (i * 0x9E3779B97F4A7C15ull) ^ (i << 40);
+		RADIX_SORT(ids);
+		for (usize i = 1; i < ids.len; ++i) assert(ids.value[i - 1] <= ids.value[i]);
+		FREE(ids.value);
+
+		__auto_type shorts = LIST(sliceof(i16), { 300, -1, 0, -32768, 32767, -300, 1 });
+		RADIX_SORT(shorts);
+		assert(shorts.value[0] == -32768 && shorts.value[1] == -300 && shorts.value[6] == 32767);
+
+		sliceof(f64) reals = SMAKE(f64, 1000);
+		for (usize i = 0; i < reals.len; ++i)
+			reals.value[i] = (i % 2 ? -1.0 : 1.0) * (f64)((i * 7919) % 1000) / 8;
+		reals.value[0] = -1.0 / 0.0;
+		reals.value[1] = 1.0 / 0.0;
+		RADIX_SORT(reals);
+		assert(reals.value[0] == -1.0 / 0.0 && reals.value[reals.len - 1] == 1.0 / 0.0);
+		for (usize i = 1; i < reals.len; ++i) assert(reals.value[i - 1] <= reals.value[i]);
+		println("sorted %zu lengths in 6 patterns, and radix sorted u64, i16 and f64.",
+			sizeof(lens) / sizeof(usize));
+		FREE(reals.value);
+	}
+
+	TEST("Parallel sorting, on a pool of workers") {
+		u64 sum = 0;
+		workers_run(workers_default(), 1000, add_squares, &sum);
+		assert(sum == 332833500);
+		sum = 0;  // Batches started from tasks run serially.
+		workers_run(workers_default(), 8, run_nested, &sum);
+		assert(sum == 8 * 328350);
+
+		WorkerPool pool;
+		workers_start(&pool, 3);
+		sum = 0;
+		for (usize i = 0; i < 50; ++i) workers_run(&pool, 10, add_squares, &sum);
+		assert(sum == 50 * 285);
+
+		// On a pool of its own, so chunks are merged by several threads
+		// whatever the machine (zero meaning all four).
+		usize threads[] = { 0, 1, 2, 3, 4 };
+		for (usize t = 0; t < sizeof(threads) / sizeof(usize); ++t) {
+			sliceof(int) xs = SMAKE(int, 200003), ys = SMAKE(int, 200003);
+			u64 seed = 7 + t;
+			for (usize i = 0; i < xs.len; ++i) {
+				seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+				xs.value[i] = ys.value[i] = (int)(seed >> 33) % 1000;
+			}
+			PSORT_ON(&pool, xs, compare_ints, threads[t]);
+			sort_with(&ys, sizeof(int), compare_ints);
+			assert(memcmp(xs.value, ys.value, xs.len * sizeof(int)) == 0);
+			FREE(xs.value); FREE(ys.value);
+		}
+		workers_stop(&pool);
+
+		sliceof(Triple) triples = SMAKE(Triple, 50000);
+		for (usize i = 0; i < triples.len; ++i)
+			triples.value[i] = (Triple){ .key = (i * 7919) % triples.len, .a = i, .b = ~i };
+		PSORT(triples, compare_triples, 4);
+		for (usize i = 0; i < triples.len; ++i) {
+			Triple *x = &triples.value[i];
+			assert(x->key == i && x->b == ~x->a && (x->a * 7919) % triples.len == i);
+		}
+		FREE(triples.value);
+
+		__auto_type few = LIST(sliceof(int), { 3, 1, 2 });
+		PSORT(few, compare_ints, 8);  // Too few to split, so sorted serially.
+		assert(few.value[0] == 1 && few.value[2] == 3);
+		println("sorted in parallel, on %u workers and the caller, and on the "
+			"%zu of the shared pool.", 3, workers_default()->count);
+	}
+
+	TEST("Searching and set operations on sorted arrays") {
+		__auto_type xs = LIST(sliceof(int), { 1, 3, 3, 3, 5, 8 });
+		assert(search_ints_lower_bound(xs.value, xs.len, 3) == 1);
+		assert(search_ints_upper_bound(xs.value, xs.len, 3) == 4);
+		assert(search_ints_lower_bound(xs.value, xs.len, 0) == 0);
+		assert(search_ints_lower_bound(xs.value, xs.len, 9) == 6);
+		Range threes = search_ints_equal_range(xs.value, xs.len, 3);
+		assert(threes.from == 1 && threes.upto == 4);
+		assert(LOWER_BOUND(xs, 4, compare_ints) == 4 && UPPER_BOUND(xs, 8, compare_ints) == 6);
+		Range fours = EQUAL_RANGE(xs, 4, compare_ints);
+		assert(fours.from == 4 && fours.upto == 4);
+
+		// Every operation, against a plain merge, for lengths
+		// near each other and far apart (which gallop).
+		usize lens[][2] = { { 0, 0 }, { 0, 10 }, { 100, 100 }, { 30, 5000 }, { 5000, 30 }, { 2000, 1500 } };
+		for (usize l = 0; l < sizeof(lens) / sizeof(*lens); ++l) {
+			usize na = lens[l][0], nb = lens[l][1];
+			sliceof(int) a = SMAKE(int, na), b = SMAKE(int, nb);
+			u64 seed = l;
+			for (usize i = 0; i < na; ++i) a.value[i] = (seed = seed * 6364136223846793005ull + 1) >> 54;
+			for (usize i = 0; i < nb; ++i) b.value[i] = (seed = seed * 6364136223846793005ull + 1) >> 54;
+			sort_ints(a.value, na);
+			sort_ints(b.value, nb);
+
+			usize room = na + nb + 1;
+			int *expect = emalloc(room, sizeof(int)), *got = emalloc(room, sizeof(int));
+			arrayof(int) out = AMAKE(int, 0);
+			for (usize op = 0; op < 4; ++op) {
+				// The plain merge: pair up equal elements one to one.
+				usize count = 0, i = 0, j = 0;
+				int *as = a.value, *bs = b.value;
+				while (i < na || j < nb) {
+					if (op == 0) {
+						bool take_a = j == nb || (i < na && as[i] <= bs[j]);
+						expect[count++] = take_a ? as[i++] : bs[j++];
+					} else if (j == nb || (i < na && as[i] < bs[j])) {
+						if (op != 2) expect[count++] = as[i];  // only in `a`.
+						++i;
+					} else if (i == na || bs[j] < as[i]) {
+						if (op == 1) expect[count++] = bs[j];  // only in `b`.
+						++j;
+					} else {
+						if (op != 3) expect[count++] = as[i];  // in both.
+						++i, ++j;
+					}
+				}
+				usize m;
+				CLEAR(out);
+				switch (op) {
+				case 0:
+					m = search_ints_merge(got, a.value, na, b.value, nb);
+					assert(SORTED_MERGE(out, a, b, compare_ints) == m);
+					break;
+				case 1:
+					m = search_ints_union(got, a.value, na, b.value, nb);
+					assert(SORTED_UNION(out, a, b, compare_ints) == m);
+					break;
+				case 2:
+					m = search_ints_intersect(got, a.value, na, b.value, nb);
+					assert(SORTED_INTERSECT(out, a, b, compare_ints) == m);
+					break;
+				default:
+					m = search_ints_difference(got, a.value, na, b.value, nb);
+					assert(SORTED_DIFFERENCE(out, a, b, compare_ints) == m);
+				}
+				assert(m == count && out.len == count);
+				assert(memcmp(got, expect, count * sizeof(int)) == 0);
+				assert(memcmp(out.value, expect, count * sizeof(int)) == 0);
+			}
+
+			// Dedup what is left of the difference.
+			usize kept = search_ints_dedup(got, out.len);
+			assert(DEDUP(out, compare_ints) == kept && out.len == kept);
+			for (usize i = 0; i < kept; ++i) {
+				assert(got[i] == out.value[i]);
+				if (i > 0) assert(got[i - 1] < got[i]);
+			}
+			AFREE(out);
+			free(expect); free(got);
+			FREE(a.value); FREE(b.value);
+		}
+
+		sliceof(Triple) triples = SMAKE(Triple, 5);
+		for (usize i = 0; i < triples.len; ++i) triples.value[i] = (Triple){ i / 2, i, 0 };
+		usize unique = DEDUP(triples, compare_triples);
+		assert(unique == 3 && triples.value[1].a == 2 && triples.value[2].a == 4);
+		println("searched, merged and deduplicated %zu pairs of lengths.",
+			sizeof(lens) / sizeof(*lens));
+		FREE(triples.value);
+	}
+
+	TEST("Parallel map, reduce, scan and partition") {
+		// Large enough to be split into many grains.
+		newslice(I32Slice, i32);
+		newslice(I64Slice, i64);
+		I32Slice xs = SMAKE(i32, 1000003);
+		for (usize i = 0; i < xs.len; ++i) xs.value[i] = (i32)(i % 2001) - 1000;
+
+		I64Slice cubes = PMAP(I64Slice, cube, xs);
+		for (usize i = 0; i < xs.len; i += 999) assert(cubes.value[i] == cube(xs.value[i]));
+		i64 sum = PREDUCE(cubes, (i64)0, ADD), serial = 0;
+		FOR_EACH(c, cubes) serial += c;
+		assert(sum == serial);
+		assert(PREDUCE(xs, 0, LATEST) == xs.value[xs.len - 1]);
+
+		PFOR_EACH(xs, negate);
+		assert(xs.value[0] == 1000 && xs.value[2000] == -1000);
+		PFOR_EACH(xs, negate);
+
+		I64Slice inclusive = PMAP(I64Slice, (i64), xs);
+		I64Slice exclusive = PMAP(I64Slice, (i64), xs);
+		PSCAN(inclusive, 0, ADD);
+		PSCAN_EXCLUSIVE(exclusive, 0, ADD);
+		i64 running = 0;
+		for (usize i = 0; i < xs.len; ++i) {
+			assert(exclusive.value[i] == running);
+			running += xs.value[i];
+			assert(inclusive.value[i] == running);
+		}
+
+		// Both keep the order, so match a serial partition.
+		I32Slice odd = PFILTER(I32Slice, IS_ODD, xs), expect = SMAKE(i32, xs.len);
+		usize kept = 0;
+		FOR_EACH(x, xs) if (IS_ODD(x)) expect.value[kept++] = x;
+		assert(odd.len == kept && memcmp(odd.value, expect.value, kept * sizeof(i32)) == 0);
+		usize evens = kept;
+		FOR_EACH(x, xs) unless (IS_ODD(x)) expect.value[evens++] = x;
+		assert(PPARTITION(xs, IS_ODD) == kept);
+		assert(memcmp(xs.value, expect.value, xs.len * sizeof(i32)) == 0);
+
+		__auto_type few = LIST(sliceof(i32), { 1, 2, 3, 4 });  // Done serially.
+		assert(PREDUCE(few, 0, ADD) == 10 && PPARTITION(few, IS_ODD) == 2);
+		assert(few.value[0] == 1 && few.value[1] == 3 && few.value[2] == 2);
+		println("mapped, reduced, scanned and partitioned %zu elements.", xs.len);
+		FREE(xs.value); FREE(cubes.value); FREE(odd.value); FREE(expect.value);
+		FREE(inclusive.value); FREE(exclusive.value);
+	}
+
+	TEST("Open-addressing tables") {
+		tableof(i32, u64) squares = TMAKE(i32, u64, 4);
+		assert(squares.engine == MAP_TABLE && squares.buckets.cap == TABLE_GROUP);
+		assert(squares.hasher == integer_hash);
+		assert(LOOKUP(squares, 0) == nil && !DROP(squares, 0));
+		for (i32 i = 0; i < 1000; ++i) ASSOCIATE(squares, i, (u64)(i * i));
+		ASSOCIATE(squares, 7, (u64)0);  //< overwrite.
+		assert(squares.len == 1000 && squares.buckets.cap == 2048);
+		assert(*LOOKUP(squares, 0) == 0 && *LOOKUP(squares, 999) == 998001);
+		assert(*LOOKUP(squares, 7) == 0 && LOOKUP(squares, -1) == nil);
+
+		// Keep dropping and adding, against a chained map doing the same.
+		mapof(i32, u64) expect = MMAKE(i32, u64, 64);
+		for (i32 i = 0; i < 1000; ++i) ASSOCIATE(expect, i, (u64)(i == 7 ? 0 : i * i));
+		u32 seed = 1;
+		for (usize step = 0; step < 20000; ++step) {
+			seed = seed * 1664525 + 1013904223;
+			i32 key = (seed >> 8) % 3000;
+			if (seed & 1) {
+				assert(DROP(squares, key) == DROP(expect, key));
+			} else {
+				ASSOCIATE(squares, key, (u64)step);
+				ASSOCIATE(expect, key, (u64)step);
+			}
+		}
+		assert(squares.len == expect.len);
+		for (i32 key = -10; key < 3010; ++key) {
+			u64 *got = LOOKUP(squares, key), *want = LOOKUP(expect, key);
+			assert((got == nil) == (want == nil));
+			assert(got == nil || *got == *want);
+			assert(HAS_KEY(squares, key) == (want != nil));
+		}
+		sliceof(i32) *keys = KEYS(squares);
+		assert(keys->len == squares.len);
+		FOR_EACH(key, *keys) assert(HAS_KEY(expect, key));
+		FREE_INSIDE(*keys);
+		println("%zu entries in %zu slots.", squares.len, squares.buckets.cap);
+
+		empty_map(&squares);
+		assert(is_empty_map(&squares) && LOOKUP(squares, 0) == nil);
+		ASSOCIATE(squares, 0, (u64)1);
+		assert(!is_empty_map(&squares) && *LOOKUP(squares, 0) == 1);
+		free_map(&squares);
+		assert(is_empty_map(&squares) && LOOKUP(squares, 0) == nil);
+		free_map(&expect);
+		// Key zero hashes to zero, which chained maps must not take as empty.
+		mapof(i32, u64) zero = MMAKE(i32, u64, 4);
+		ASSOCIATE(zero, 0, (u64)1);
+		ASSOCIATE(zero, 0, (u64)2);
+		assert(zero.len == 1 && *LOOKUP(zero, 0) == 2 && HAS_KEY(zero, 0));
+		assert(DROP(zero, 0) && LOOKUP(zero, 0) == nil);
+		free_map(&zero);
+
+		tableof(string, u16) dict = TMAKE(string, u16, 2);
+		assert(dict.hasher == string_hash);
+		string words[] = { STR("ab"), STR("bc"), STR("ca"), STR("ad"), STR("da") };
+		for (usize i = 0; i < sizeof(words) / sizeof(*words); ++i) ASSOCIATE(dict, words[i], (u16)i);
+		dump_hashmap(&dict, "\"%S\"", "%hu");
+		assert(DROP(dict, STR("bc")) && !HAS_KEY(dict, STR("bc")));
+		assert(*LOOKUP(dict, STR("da")) == 4 && dict.len == 4);
+		free_map(&dict);
+	}
+
+	TEST("Incremental map resizing") {
+		CountingAllocator counter = { 0 };
+		Allocator counting = {
+			.alloc = counting_alloc,
+			.realloc = counting_realloc,
+			.free = counting_free,
+			.context = &counter
+		};
+		mapof(i32, i32) map = MMAKE_WITH(i32, i32, 8, &counting);
+		mapof(i32, i32) expect = MMAKE(i32, i32, 8);
+		map.incremental = true;
+
+		// Each operation only zeroes and moves a few buckets along.
+		usize resizes = 0, most_moved = 0, most_cleared = 0;
+		u32 seed = 3;
+		for (i32 step = 0; step < 50000; ++step) {
+			seed = seed * 1664525 + 1013904223;
+			i32 key = (seed >> 8) % 20000;
+			bool was_resizing = map.old_buckets.value != nil;
+			usize moved = map.moved, cleared = map.cleared;
+			switch (seed % 3) {
+			case 0:
+				assert(DROP(map, key) == DROP(expect, key));
+				break;
+			case 1: {
+				i32 *found = LOOKUP(map, key);
+				assert((found == nil) == (LOOKUP(expect, key) == nil));
+			} break;
+			default:
+				ASSOCIATE(map, key, step);
+				ASSOCIATE(expect, key, step);
+			}
+			unless (was_resizing) resizes += map.old_buckets.value != nil;
+			else if (map.moved > moved) most_moved = max(most_moved, map.moved - moved);
+			else if (map.cleared > cleared) most_cleared = max(most_cleared, map.cleared - cleared);
+			assert(map.len == expect.len);
+		}
+		assert(resizes >= 8 && most_moved == HASHMAP_REHASH_STEP);
+		assert(most_cleared > 0 && most_cleared <= 4 * HASHMAP_REHASH_STEP);
+		println("%zu resizes, to %zu buckets.", resizes, map.buckets.cap);
+		for (i32 key = 0; key < 20000; ++key) {
+			i32 *got = LOOKUP(map, key), *want = LOOKUP(expect, key);
+			assert((got == nil) == (want == nil) && (got == nil || *got == *want));
+		}
+
+		sliceof(i32) *keys = KEYS(map);  //< finishes any resize.
+		assert(keys->len == map.len && map.old_buckets.value == nil);
+		FREE_INSIDE(*keys);
+		free_map(&map);
+		free_map(&expect);
+		assert(counter.blocks == 0 && counter.bytes == 0);
+	}
+
+	TEST("Iterating over map entries") {
+		CountingAllocator counter = { 0 };
+		Allocator counting = {
+			.alloc = counting_alloc,
+			.realloc = counting_realloc,
+			.free = counting_free,
+			.context = &counter
+		};
+		mapof(i32, i64) squares = MMAKE_WITH(i32, i64, 16, &counting);
+		tableof(i32, i64) cubes = TMAKE_WITH(i32, i64, 16, &counting);
+		squares.incremental = true;
+
+		FOR_EACH_ENTRY(x, square, squares) assert(!"no entries");
+		for (i32 x = -500; x < 500; ++x) {
+			ASSOCIATE(squares, x, (i64)x * x);
+			ASSOCIATE(cubes, x, (i64)x * x * x);
+		}
+		assert(squares.old_buckets.value != nil);  //< part way through a resize.
+
+		isize blocks = counter.blocks;
+		usize entries = 0, keys = 0, values = 0;
+		i64 sum = 0;
+		FOR_EACH_ENTRY(x, square, squares) {
+			assert(square == (i64)x * x && it.entry->value == square);
+			++entries;
+		}
+		FOR_EACH_ENTRY(x, cube, cubes) {
+			assert(cube == (i64)x * x * x);
+			sum += cube;
+		}
+		FOR_EACH_KEY(x, squares) keys += HAS_KEY(cubes, x);
+		FOR_EACH_VALUE(cube, cubes) values += cube >= 0;
+		assert(entries == 1000 && keys == 1000 && values == 500 && sum == -125000000);
+		FOR_EACH_KEY(x, cubes) {
+			if (x == 7) break;
+			++keys;
+		}
+		assert(keys < 2000);
+		assert(counter.blocks == blocks);  //< nothing allocated.
+		assert(squares.old_buckets.value != nil);  //< nor moved.
+
+		assert(HAS_KEY(squares, -500) && !HAS_KEY(squares, 500));
+		free_map(&squares);
+		free_map(&cubes);
+		FOR_EACH_ENTRY(x, cube, cubes) assert(!"no entries");
+		assert(counter.blocks == 0);
+	}
+
+	TEST("Building and looking up maps in bulk") {
+		newslice(I32Slice, i32);
+		newslice(U64Slice, u64);
+		I32Slice keys = SMAKE(i32, 3001), absent = SMAKE(i32, 100);
+		U64Slice values = SMAKE(u64, keys.len);
+		for (usize i = 0; i < keys.len; ++i) {
+			keys.value[i] = (i32)(i * 7919 % 100003);
+			values.value[i] = i;
+		}
+		for (usize i = 0; i < absent.len; ++i) absent.value[i] = -1 - (i32)i;
+
+		mapof(i32, u64) map = MMAKE(i32, u64, 1);
+		tableof(i32, u64) table = TMAKE(i32, u64, 0);
+		mapof(i32, u64) incremental = MMAKE(i32, u64, 1);
+		incremental.incremental = true;
+		ASSOCIATE(map, keys.value[0], (u64)99);  //< to be overwritten.
+		ASSOCIATE_MANY(map, keys, values);
+		ASSOCIATE_MANY(table, keys, values);
+		ASSOCIATE_MANY(incremental, keys, values);
+		// Room was made up front, so there was just the one resize.
+		assert(table.buckets.cap == table_capacity(keys.len));
+		assert(map.buckets.cap > keys.len / HASHMAP_LOAD_THRESHOLD);
+		assert(map.buckets.cap < 2 * keys.len / HASHMAP_LOAD_THRESHOLD);
+		assert(map.len == keys.len && table.len == keys.len && incremental.len == keys.len);
+
+		u64 **found = emalloc(keys.len, sizeof(u64 *));
+		assert(LOOKUP_MANY(map, keys, found) == keys.len);
+		for (usize i = 0; i < keys.len; ++i) assert(*found[i] == i);
+		assert(LOOKUP_MANY(table, keys, found) == keys.len);
+		for (usize i = 0; i < keys.len; ++i) assert(found[i] == LOOKUP(table, keys.value[i]));
+		assert(LOOKUP_MANY(incremental, keys, found) == keys.len);
+		for (usize i = 0; i < keys.len; ++i) assert(*found[i] == i);
+		assert(LOOKUP_MANY(map, absent, found) == 0 && found[absent.len - 1] == nil);
+		assert(LOOKUP_MANY(table, absent, found) == 0 && found[0] == nil);
+
+		// From no buckets at all, with nothing to resize incrementally.
+		mapof(i32, u64) empty = MMAKE(i32, u64, 0);
+		empty.incremental = true;
+		assert(!DROP(empty, keys.value[0]));
+		assert(LOOKUP_MANY(empty, absent, found) == 0 && LOOKUP(empty, keys.value[0]) == nil);
+		ASSOCIATE_MANY(empty, keys, values);
+		assert(empty.len == keys.len && empty.old_buckets.value == nil);
+		assert(LOOKUP_MANY(empty, keys, found) == keys.len && *found[keys.len - 1] == keys.len - 1);
+		free_map(&empty);
+		empty = (typeof(empty))MMAKE(i32, u64, 0);
+		assert(!DROP(empty, keys.value[0]));
+		ASSOCIATE(empty, keys.value[0], (u64)7);
+		assert(*LOOKUP(empty, keys.value[0]) == 7);
+
+		free_map(&map);
+		free_map(&table);
+		free_map(&incremental);
+		free_map(&empty);
+		FREE(found);
+		FREE(keys.value); FREE(absent.value); FREE(values.value);
+	}
+
+	TEST("Hashing keys") {
+		// Every length takes a different path through `hash_bytes`.
+		byte text[200];
+		for (usize i = 0; i < sizeof(text); ++i) text[i] = 'a' + i % 26;
+		u64 hashes[sizeof(text)];
+		for (usize len = 0; len < sizeof(text); ++len) {
+			MemSlice bytes = VIEW(MemSlice, (umin *)text, 0, len);
+			hashes[len] = hash_bytes(bytes);
+			for (usize shorter = 0; shorter < len; ++shorter)
+				assert(hashes[shorter] != hashes[len]);
+			assert(hash_bytes_seeded(bytes, 1) != hashes[len]);
+			assert(hash_bytes_seeded(bytes, 0) == hashes[len]);
+		}
+		// Flipping any one bit of a key flips about half of the hash.
+		usize flipped = 0;
+		for (usize bit = 0; bit < 64; ++bit) {
+			text[bit / 8] ^= 1 << bit % 8;
+			MemSlice key = VIEW(MemSlice, (umin *)text, 0, 8);
+			flipped += __builtin_popcountll(hash_bytes(key) ^ hashes[8]);
+			flipped += __builtin_popcountll(hash_integer(1ull << bit) ^ hash_integer(0));
+			text[bit / 8] ^= 1 << bit % 8;
+		}
+		assert(flipped > 2 * 64 * 28 && flipped < 2 * 64 * 36);
+		println("one bit flipped %.1f bits of the hash, on average.", flipped / 128.0);
+
+		// Consecutive integers spread out over the buckets.
+		bool seen[64] = { false };
+		usize buckets = 0;
+		for (u64 x = 0; x < 64; ++x) {
+			usize index = hash_integer(x * 64) % 64;
+			buckets += !seen[index];
+			seen[index] = true;
+		}
+		assert(buckets > 32);
+		assert(hash_integer_seeded(7, 1) != hash_integer(7));
+	}
+
 	TEST("Argument parsing") {
 		ArgParser ctx;
 		mapof(ArgID, Arg) options = MMAKE(ArgID, Arg, 15);